@@ -0,0 +1,283 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include "numa.hpp"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+// Bump allocation for the partitions of a lattice level. Memory comes in
+// chunks of whole 2 MB pages, taken from explicit huge pages (MAP_HUGETLB)
+// when asked to and any are reserved, otherwise from ordinary mappings
+// aligned and advised for transparent huge pages. Released chunks go back
+// to a per-node pool, so the next level reuses pages that are already
+// faulted in instead of mapping fresh ones.
+
+const size_t HUGE_PAGE_BYTES = (size_t)2 << 20;
+const size_t ARENA_CHUNK_BYTES = (size_t)32 << 20;
+
+struct ArenaChunk {
+    char *base = nullptr;
+    size_t bytes = 0;
+    int node = -1;
+    bool hugePages = false;
+};
+
+inline ArenaChunk mapArenaChunk(size_t bytes, bool hugePages, int node) {
+    bytes = (bytes + HUGE_PAGE_BYTES - 1) & ~(HUGE_PAGE_BYTES - 1);
+    NumaPolicy policy = node >= 0 ? NumaPolicy::Bind : NumaPolicy::Local;
+    ArenaChunk chunk;
+    chunk.bytes = bytes;
+    chunk.node = node;
+    chunk.hugePages = hugePages;
+
+    if (hugePages) {
+        void *ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) {
+            numaBind(ptr, bytes, policy, node);
+            chunk.base = static_cast<char *>(ptr);
+            return chunk;
+        }
+    }
+
+    // Over-map by a huge page and trim, so the chunk is 2 MB aligned and
+    // transparent huge pages can back all of it
+    size_t mapped = bytes + HUGE_PAGE_BYTES;
+    void *ptr = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    uintptr_t start = reinterpret_cast<uintptr_t>(ptr);
+    uintptr_t aligned = (start + HUGE_PAGE_BYTES - 1) & ~(uintptr_t)(HUGE_PAGE_BYTES - 1);
+    if (aligned > start) {
+        munmap(ptr, aligned - start);
+    }
+    if (aligned + bytes < start + mapped) {
+        munmap(reinterpret_cast<void *>(aligned + bytes), start + mapped - aligned - bytes);
+    }
+    chunk.base = reinterpret_cast<char *>(aligned);
+    if (hugePages) {
+        madvise(chunk.base, bytes, MADV_HUGEPAGE);
+    }
+    numaBind(chunk.base, bytes, policy, node);
+    return chunk;
+}
+
+// Standard-size chunks freed by arenas, kept for reuse
+class ArenaChunkPool {
+private:
+    std::mutex lock;
+    std::vector<ArenaChunk> chunks;
+
+public:
+    static ArenaChunkPool &get() {
+        static ArenaChunkPool pool;
+        return pool;
+    }
+
+    ~ArenaChunkPool() {
+        clear();
+    }
+
+    ArenaChunk acquire(size_t bytes, bool hugePages, int node) {
+        if (bytes <= ARENA_CHUNK_BYTES) {
+            std::lock_guard<std::mutex> guard(lock);
+            for (size_t i = chunks.size(); i-- > 0;) {
+                if (chunks[i].node == node && chunks[i].hugePages == hugePages) {
+                    ArenaChunk chunk = chunks[i];
+                    chunks[i] = chunks.back();
+                    chunks.pop_back();
+                    return chunk;
+                }
+            }
+        }
+        return mapArenaChunk(std::max(bytes, ARENA_CHUNK_BYTES), hugePages, node);
+    }
+
+    void release(const ArenaChunk &chunk) {
+        if (chunk.bytes != ARENA_CHUNK_BYTES) {
+            munmap(chunk.base, chunk.bytes);
+            return;
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        chunks.push_back(chunk);
+    }
+
+    // Returns pooled chunks to the OS
+    void clear() {
+        std::lock_guard<std::mutex> guard(lock);
+        for (const auto &chunk : chunks) {
+            munmap(chunk.base, chunk.bytes);
+        }
+        chunks.clear();
+    }
+};
+
+// Single-threaded bump allocator. Nothing is freed individually; release()
+// hands every chunk back at once.
+class Arena {
+private:
+    std::vector<ArenaChunk> chunks;
+    size_t used = 0;
+    bool hugePages = false;
+    int node = -1;
+
+public:
+    Arena() {}
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    ~Arena() {
+        release();
+    }
+
+    void configure(bool hugePages, int node) {
+        this->hugePages = hugePages;
+        this->node = node;
+    }
+
+    void *allocate(size_t bytes, size_t align = 64) {
+        if (!chunks.empty()) {
+            size_t start = (used + align - 1) & ~(align - 1);
+            if (start + bytes <= chunks.back().bytes) {
+                used = start + bytes;
+                return chunks.back().base + start;
+            }
+        }
+        chunks.push_back(ArenaChunkPool::get().acquire(bytes, hugePages, node));
+        used = bytes;
+        return chunks.back().base;
+    }
+
+    template <typename T>
+    T *allocateArray(size_t count) {
+        return static_cast<T *>(allocate(count * sizeof(T), std::max<size_t>(alignof(T), 64)));
+    }
+
+    // Shrinks the most recent allocation, which starts at ptr, to bytes
+    void trim(void *ptr, size_t bytes) {
+        if (!chunks.empty() && static_cast<char *>(ptr) >= chunks.back().base &&
+            static_cast<char *>(ptr) < chunks.back().base + chunks.back().bytes) {
+            used = static_cast<char *>(ptr) - chunks.back().base + bytes;
+        }
+    }
+
+    size_t reserved() const {
+        size_t bytes = 0;
+        for (const auto &chunk : chunks) {
+            bytes += chunk.bytes;
+        }
+        return bytes;
+    }
+
+    // Frees every allocation but keeps the first chunk for reuse
+    void reset() {
+        if (chunks.size() > 1) {
+            for (size_t c = 1; c < chunks.size(); c++) {
+                ArenaChunkPool::get().release(chunks[c]);
+            }
+            chunks.resize(1);
+        }
+        used = 0;
+    }
+
+    void release() {
+        for (const auto &chunk : chunks) {
+            ArenaChunkPool::get().release(chunk);
+        }
+        chunks.clear();
+        used = 0;
+    }
+};
+
+// One arena per (lattice level, worker slot), so workers never contend for
+// allocation. Tasks register under the level they produce; the partitions of
+// level k are read only by tasks producing level k + 1, so once no task
+// producing a level up to k + 1 is outstanding, level k is released in bulk.
+// Levels finish in order because a task only ever submits deeper tasks.
+class LevelArenas {
+private:
+    int levels;
+    int slots;
+    std::vector<std::unique_ptr<Arena[]>> arenas;
+    std::unique_ptr<std::atomic<long>[]> pending;
+    std::mutex releaseLock;
+    int released = 0;
+
+    void releaseLevel(int level) {
+        for (int s = 0; s < slots; s++) {
+            arenas[level][s].release();
+        }
+    }
+
+public:
+    LevelArenas(int levels, int slots, bool hugePages)
+        : levels(levels), slots(std::max(1, slots)), pending(new std::atomic<long>[levels + 2]) {
+        const NumaTopology &topology = NumaTopology::get();
+        for (int l = 0; l < levels + 2; l++) {
+            pending[l].store(0);
+        }
+        for (int l = 0; l < levels; l++) {
+            arenas.emplace_back(new Arena[this->slots]);
+            for (int s = 0; s < this->slots; s++) {
+                // Slot s is worker s - 1, which the scheduler pins round-robin
+                int node = topology.nodeCount() > 1 && s > 0 ? (s - 1) % topology.nodeCount() : -1;
+                arenas[l][s].configure(hugePages, node);
+            }
+        }
+    }
+
+    // Arena for partitions of `level`, for the caller in worker slot `slot`
+    Arena &get(int level, int slot) {
+        return arenas[level][slot];
+    }
+
+    void taskSubmitted(int level) {
+        pending[level]++;
+    }
+
+    void taskFinished(int level) {
+        if (--pending[level] > 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> guard(releaseLock);
+        long outstanding = 0;
+        for (int l = 0; l <= std::min(released + 1, levels + 1); l++) {
+            outstanding += pending[l].load();
+        }
+        while (released < levels && outstanding == 0) {
+            releaseLevel(released);
+            released++;
+            if (released + 1 <= levels + 1) {
+                outstanding += pending[released + 1].load();
+            }
+        }
+    }
+
+    // Releases one level directly, for callers that run level by level
+    // instead of counting tasks
+    void release(int level) {
+        std::lock_guard<std::mutex> guard(releaseLock);
+        releaseLevel(level);
+    }
+
+    size_t reserved() const {
+        size_t bytes = 0;
+        for (int l = 0; l < levels; l++) {
+            for (int s = 0; s < slots; s++) {
+                bytes += arenas[l][s].reserved();
+            }
+        }
+        return bytes;
+    }
+};
+
+#endif // ARENA_HPP
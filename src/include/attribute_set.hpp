@@ -0,0 +1,338 @@
+#ifndef ATTRIBUTE_SET_HPP
+#define ATTRIBUTE_SET_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Fixed-width attribute set: one bit per attribute in Words 64-bit words.
+// Copies are a few word moves, comparisons are word compares and iteration
+// walks the set bits, so engines instantiated per width carry no allocation
+// in their lattice bookkeeping. The set operations are constexpr, so masks
+// built from constants fold at compile time.
+template <int Words>
+class AttributeMask {
+private:
+    uint64_t words[Words];
+
+    static constexpr int popcount(uint64_t word) {
+        return __builtin_popcountll(word);
+    }
+
+public:
+    static constexpr int CAPACITY = 64 * Words;
+
+    constexpr AttributeMask() : words{} {}
+
+    constexpr AttributeMask(std::initializer_list<int> atts) : words{} {
+        for (int att : atts) {
+            insert(att);
+        }
+    }
+
+    static constexpr AttributeMask fromWords(const uint64_t *source) {
+        AttributeMask mask;
+        for (int w = 0; w < Words; w++) {
+            mask.words[w] = source[w];
+        }
+        return mask;
+    }
+
+    // Set whose first 64 attributes are the bits of word
+    static constexpr AttributeMask fromLowWord(uint64_t word) {
+        AttributeMask mask;
+        mask.words[0] = word;
+        return mask;
+    }
+
+    // Attributes [0, count)
+    static constexpr AttributeMask firstN(int count) {
+        AttributeMask mask;
+        for (int w = 0; w < Words && count > 0; w++, count -= 64) {
+            mask.words[w] = count >= 64 ? ~0ULL : (1ULL << count) - 1;
+        }
+        return mask;
+    }
+
+    constexpr uint64_t word(int w) const {
+        return words[w];
+    }
+
+    constexpr bool contains(int att) const {
+        return (words[att >> 6] >> (att & 63)) & 1;
+    }
+
+    constexpr void insert(int att) {
+        words[att >> 6] |= 1ULL << (att & 63);
+    }
+
+    constexpr void erase(int att) {
+        words[att >> 6] &= ~(1ULL << (att & 63));
+    }
+
+    constexpr bool empty() const {
+        for (int w = 0; w < Words; w++) {
+            if (words[w] != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    constexpr int size() const {
+        int count = 0;
+        for (int w = 0; w < Words; w++) {
+            count += popcount(words[w]);
+        }
+        return count;
+    }
+
+    // Smallest attribute, or -1 if empty
+    constexpr int first() const {
+        for (int w = 0; w < Words; w++) {
+            if (words[w] != 0) {
+                return w * 64 + __builtin_ctzll(words[w]);
+            }
+        }
+        return -1;
+    }
+
+    // Largest attribute, or -1 if empty
+    constexpr int last() const {
+        for (int w = Words - 1; w >= 0; w--) {
+            if (words[w] != 0) {
+                return w * 64 + 63 - __builtin_clzll(words[w]);
+            }
+        }
+        return -1;
+    }
+
+    // Smallest attribute greater than att, or -1
+    constexpr int next(int att) const {
+        att++;
+        int w = att >> 6;
+        if (w >= Words) {
+            return -1;
+        }
+        uint64_t rest = (att & 63) == 0 ? words[w] : words[w] & (~0ULL << (att & 63));
+        while (true) {
+            if (rest != 0) {
+                return w * 64 + __builtin_ctzll(rest);
+            }
+            if (++w == Words) {
+                return -1;
+            }
+            rest = words[w];
+        }
+    }
+
+    constexpr bool isSubsetOf(const AttributeMask &other) const {
+        for (int w = 0; w < Words; w++) {
+            if ((words[w] & ~other.words[w]) != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    constexpr AttributeMask &operator|=(const AttributeMask &other) {
+        for (int w = 0; w < Words; w++) {
+            words[w] |= other.words[w];
+        }
+        return *this;
+    }
+
+    constexpr AttributeMask &operator&=(const AttributeMask &other) {
+        for (int w = 0; w < Words; w++) {
+            words[w] &= other.words[w];
+        }
+        return *this;
+    }
+
+    // Set difference
+    constexpr AttributeMask &operator-=(const AttributeMask &other) {
+        for (int w = 0; w < Words; w++) {
+            words[w] &= ~other.words[w];
+        }
+        return *this;
+    }
+
+    friend constexpr AttributeMask operator|(AttributeMask a, const AttributeMask &b) { return a |= b; }
+    friend constexpr AttributeMask operator&(AttributeMask a, const AttributeMask &b) { return a &= b; }
+    friend constexpr AttributeMask operator-(AttributeMask a, const AttributeMask &b) { return a -= b; }
+
+    friend constexpr bool operator==(const AttributeMask &a, const AttributeMask &b) {
+        for (int w = 0; w < Words; w++) {
+            if (a.words[w] != b.words[w]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    friend constexpr bool operator!=(const AttributeMask &a, const AttributeMask &b) {
+        return !(a == b);
+    }
+
+    // Lexicographic order of the sorted attribute lists, as for std::set<int>.
+    // With d the smallest attribute in exactly one of the sets, the one that
+    // holds d is smaller unless the other set has nothing beyond d.
+    friend constexpr bool operator<(const AttributeMask &a, const AttributeMask &b) {
+        for (int w = 0; w < Words; w++) {
+            uint64_t diff = a.words[w] ^ b.words[w];
+            if (diff != 0) {
+                int d = w * 64 + __builtin_ctzll(diff);
+                const AttributeMask &holder = a.contains(d) ? a : b;
+                const AttributeMask &other = a.contains(d) ? b : a;
+                bool otherContinues = other.next(d) >= 0;
+                return &holder == &a ? otherContinues : !otherContinues;
+            }
+        }
+        return false;
+    }
+
+    constexpr size_t hash() const {
+        uint64_t h = 0x9e3779b97f4a7c15ULL;
+        for (int w = 0; w < Words; w++) {
+            uint64_t x = words[w] + h;
+            // splitmix64 finalizer
+            x ^= x >> 30;
+            x *= 0xbf58476d1ce4e5b9ULL;
+            x ^= x >> 27;
+            x *= 0x94d049bb133111ebULL;
+            x ^= x >> 31;
+            h = x;
+        }
+        return (size_t)h;
+    }
+
+    class const_iterator {
+    private:
+        const AttributeMask *mask;
+        int att;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = int;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const int *;
+        using reference = int;
+
+        const_iterator(const AttributeMask *mask, int att) : mask(mask), att(att) {}
+        int operator*() const { return att; }
+        const_iterator &operator++() {
+            att = mask->next(att);
+            return *this;
+        }
+        bool operator==(const const_iterator &other) const { return att == other.att; }
+        bool operator!=(const const_iterator &other) const { return att != other.att; }
+    };
+
+    const_iterator begin() const {
+        return const_iterator(this, first());
+    }
+
+    const_iterator end() const {
+        return const_iterator(this, -1);
+    }
+};
+
+template <int Words>
+struct AttributeMaskHash {
+    size_t operator()(const AttributeMask<Words> &mask) const {
+        return mask.hash();
+    }
+};
+
+template <int Words>
+std::string toString(const AttributeMask<Words> &attrSet) {
+    std::string str = "AttrSet{";
+    for (const int &val : attrSet) {
+        str += std::to_string(val) + ", ";
+    }
+    if (!attrSet.empty()) {
+        str.pop_back(); // Remove trailing space and comma
+        str.pop_back();
+    }
+    str += "}";
+    return str;
+}
+
+// Maps attribute sets through a permutation of attribute indices, one byte
+// of the mask at a time: table[b][v] is the image of the attributes that byte
+// value v selects in byte b, so a set is translated with one lookup and OR
+// per non-zero byte instead of a bit at a time.
+template <int Words>
+class AttributePermutation {
+private:
+    std::vector<AttributeMask<Words>> table;
+    bool identity = true;
+
+    uint8_t byteOf(const AttributeMask<Words> &mask, int b) const {
+        return (uint8_t)(mask.word(b >> 3) >> ((b & 7) * 8));
+    }
+
+public:
+    AttributePermutation() {}
+
+    // image[i] is where attribute i is mapped to
+    explicit AttributePermutation(const std::vector<int> &image) {
+        for (size_t i = 0; i < image.size(); i++) {
+            identity = identity && image[i] == (int)i;
+        }
+        if (identity) {
+            return;
+        }
+        int bytes = ((int)image.size() + 7) / 8;
+        table.resize((size_t)bytes * 256);
+        for (int b = 0; b < bytes; b++) {
+            for (int v = 1; v < 256; v++) {
+                // Extend the image of v without its lowest bit by that bit
+                int low = __builtin_ctz(v);
+                AttributeMask<Words> &entry = table[b * 256 + v];
+                entry = table[b * 256 + (v & (v - 1))];
+                if (b * 8 + low < (int)image.size()) {
+                    entry.insert(image[b * 8 + low]);
+                }
+            }
+        }
+    }
+
+    bool isIdentity() const {
+        return identity;
+    }
+
+    AttributeMask<Words> apply(const AttributeMask<Words> &mask) const {
+        if (identity) {
+            return mask;
+        }
+        AttributeMask<Words> result;
+        int bytes = (int)(table.size() / 256);
+        for (int b = 0; b < bytes; b++) {
+            uint8_t v = byteOf(mask, b);
+            if (v != 0) {
+                result |= table[b * 256 + v];
+            }
+        }
+        return result;
+    }
+
+    // The permutation mapping image[i] back to i
+    static std::vector<int> invert(const std::vector<int> &image) {
+        std::vector<int> inverse(image.size());
+        for (size_t i = 0; i < image.size(); i++) {
+            inverse[image[i]] = (int)i;
+        }
+        return inverse;
+    }
+};
+
+// Smallest width that holds attributeCount attributes: 1, 2 or 4 words
+inline int latticeWords(int attributeCount) {
+    return attributeCount <= 64 ? 1 : attributeCount <= 128 ? 2 : 4;
+}
+
+#endif // ATTRIBUTE_SET_HPP
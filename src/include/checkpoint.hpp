@@ -0,0 +1,110 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// State of a level-wise run after its last completed level: everything mined
+// so far and the sets of that level, from which the traversal continues.
+// Sets are in physical attributes. Partitions are not saved; the frontier's
+// are rebuilt from the columns on resume.
+template <typename Key>
+struct Checkpoint {
+    // Sections are written as raw arrays of these
+    struct Entry {
+        Key attSet;
+        double entropy;
+    };
+
+    struct Dependency {
+        Key lhs;
+        uint64_t rhs;
+    };
+
+    uint64_t fingerprint = 0;   // datasetFingerprint() of the source
+    uint64_t attributeCount = 0;
+    uint64_t tupleCount = 0;
+    std::vector<Entry> entropies;
+    std::vector<Key> keys;
+    std::vector<Dependency> dependencies;
+    std::vector<Key> frontier;  // Empty once the lattice is done
+};
+
+const uint64_t CHECKPOINT_FILE_MAGIC = 0x54504b434d494d53ULL; // "SMIMCKPT"
+
+template <typename T>
+void writeCheckpointSection(FILE *file, const std::vector<T> &items) {
+    uint64_t count = items.size();
+    std::fwrite(&count, sizeof(count), 1, file);
+    if (count > 0) {
+        std::fwrite(items.data(), sizeof(T), count, file);
+    }
+}
+
+// False on a short read, or a count larger than the fileSize bytes left
+// could hold, so a corrupt count never sizes an allocation
+template <typename T>
+bool readCheckpointSection(FILE *file, uint64_t fileSize, std::vector<T> &items) {
+    uint64_t count;
+    if (std::fread(&count, sizeof(count), 1, file) != 1) {
+        return false;
+    }
+    long offset = std::ftell(file);
+    if (offset < 0 || (uint64_t)offset > fileSize || count > (fileSize - (uint64_t)offset) / sizeof(T)) {
+        return false;
+    }
+    items.resize(count);
+    return count == 0 || std::fread(items.data(), sizeof(T), count, file) == count;
+}
+
+// Written beside the target, synced and renamed over it, so a process killed
+// at any point leaves either the previous checkpoint or the new one
+template <typename Key>
+void writeCheckpointFile(const std::string &path, const Checkpoint<Key> &checkpoint) {
+    std::string tmpPath = path + ".tmp";
+    FILE *file = std::fopen(tmpPath.c_str(), "wb");
+    if (file == nullptr) {
+        throw std::runtime_error("Could not create checkpoint file " + tmpPath);
+    }
+    uint64_t header[5] = {CHECKPOINT_FILE_MAGIC, sizeof(Key), checkpoint.fingerprint, checkpoint.attributeCount, checkpoint.tupleCount};
+    std::fwrite(header, sizeof(header), 1, file);
+    writeCheckpointSection(file, checkpoint.entropies);
+    writeCheckpointSection(file, checkpoint.keys);
+    writeCheckpointSection(file, checkpoint.dependencies);
+    writeCheckpointSection(file, checkpoint.frontier);
+    bool written = !std::ferror(file) && std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+    if (std::fclose(file) != 0 || !written || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        throw std::runtime_error("Could not write checkpoint file " + path);
+    }
+}
+
+template <typename Key>
+Checkpoint<Key> readCheckpointFile(const std::string &path) {
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        throw std::runtime_error("Could not open checkpoint file " + path);
+    }
+    Checkpoint<Key> checkpoint;
+    uint64_t header[5];
+    long fileSize = std::fseek(file, 0, SEEK_END) == 0 ? std::ftell(file) : -1;
+    bool valid = fileSize >= 0 && std::fseek(file, 0, SEEK_SET) == 0 && std::fread(header, sizeof(header), 1, file) == 1 &&
+        header[0] == CHECKPOINT_FILE_MAGIC && header[1] == sizeof(Key) &&
+        readCheckpointSection(file, fileSize, checkpoint.entropies) && readCheckpointSection(file, fileSize, checkpoint.keys) &&
+        readCheckpointSection(file, fileSize, checkpoint.dependencies) && readCheckpointSection(file, fileSize, checkpoint.frontier);
+    std::fclose(file);
+    if (!valid) {
+        throw std::runtime_error("Malformed checkpoint file " + path);
+    }
+    checkpoint.fingerprint = header[2];
+    checkpoint.attributeCount = header[3];
+    checkpoint.tupleCount = header[4];
+    return checkpoint;
+}
+
+#endif // CHECKPOINT_HPP
@@ -0,0 +1,263 @@
+#ifndef COMPRESSED_PARTITION_HPP
+#define COMPRESSED_PARTITION_HPP
+
+#include "partition.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Stripped partition whose classes, being sorted TID lists, are stored as
+// blocks of up to 128 TIDs: the first TID in full, then the gaps to the next
+// ones minus one, bit-packed at the block's widest gap. Gaps within a class
+// of N rows split into k classes are around N / k, so a block costs
+// log2(N / k) bits per TID instead of 32 or 64. A gap wider than 32 bits,
+// only possible with 64-bit row ids, starts a new block.
+//
+// Decoding unpacks the gaps and restores TIDs with a 4-lane SSE2 prefix sum
+// (scalar for 64-bit row ids).
+// Refinement consumes the blocks of one class at a time, so a compressed
+// parent is never expanded as a whole.
+
+const int PACKED_BLOCK_ROWS = 128;
+
+struct PackedBlock {
+    RowId base;       // First TID
+    RowId offset;     // First word of the packed gaps
+    uint16_t count;   // TIDs in the block, base included
+    uint8_t bits;     // Width of each packed gap
+};
+
+struct CompressedPartition {
+    NumaArray<RowId> classBlocks;     // Blocks of class i: [classBlocks[i], classBlocks[i+1])
+    NumaArray<PackedBlock> blocks;
+    NumaArray<uint32_t> words;        // Packed gaps, plus a zero word of padding
+    size_t rows = 0;
+    double sumCLogC = 0;
+
+    size_t rowCount() const {
+        return rows;
+    }
+
+    size_t classCount() const {
+        return classBlocks.size() == 0 ? 0 : classBlocks.size() - 1;
+    }
+
+    int node() const {
+        return words.node();
+    }
+
+    size_t bytes() const {
+        return classBlocks.size() * sizeof(RowId) + blocks.size() * sizeof(PackedBlock) + words.size() * sizeof(uint32_t);
+    }
+};
+
+template <typename T>
+NumaArray<T> allocateArray(size_t capacity, Arena *arena, int node) {
+    if (arena != nullptr) {
+        return NumaArray<T>::borrow(arena->allocateArray<T>(capacity), capacity, node);
+    }
+    return NumaArray<T>(capacity, node >= 0 ? NumaPolicy::Bind : NumaPolicy::Local, node);
+}
+
+// Length of the block starting at tids[0], of at most `count` TIDs, and the
+// OR of its gaps
+inline size_t packedBlockLength(const RowId *tids, size_t count, uint32_t &widest) {
+    size_t n = std::min<size_t>(PACKED_BLOCK_ROWS, count);
+    widest = 0;
+    for (size_t i = 1; i < n; i++) {
+        uint64_t gap = tids[i] - tids[i - 1] - 1;
+        if (gap > UINT32_MAX) {
+            return i;
+        }
+        widest |= (uint32_t)gap;
+    }
+    return n;
+}
+
+// Size compressPartition() would produce, without encoding anything.
+// Partitions of many tiny classes gain little: a block header costs as much
+// as three raw TIDs.
+inline size_t compressedBytes(const StrippedPartition &partition) {
+    size_t blocks = 0;
+    size_t words = 1;
+    for (size_t c = 0; c < partition.classCount(); c++) {
+        const RowId *tids = partition.rows.data() + partition.offsets[c];
+        size_t count = partition.offsets[c + 1] - partition.offsets[c];
+        uint32_t widest;
+        for (size_t start = 0, n; start < count; start += n) {
+            n = packedBlockLength(tids + start, count - start, widest);
+            int bits = widest == 0 ? 0 : 32 - __builtin_clz(widest);
+            words += ((n - 1) * bits + 31) / 32;
+            blocks++;
+        }
+    }
+    return (partition.classCount() + 1) * sizeof(RowId) + blocks * sizeof(PackedBlock) + words * sizeof(uint32_t);
+}
+
+inline CompressedPartition compressPartition(const StrippedPartition &partition, Arena *arena = nullptr) {
+    int node = currentNumaNode();
+    size_t rows = partition.rowCount();
+    size_t classes = partition.classCount();
+    size_t maxBlocks = classes + rows / PACKED_BLOCK_ROWS + 1;
+    if (sizeof(RowId) > sizeof(uint32_t)) {
+        // Every gap too wide to pack starts another block
+        for (size_t c = 0; c < classes; c++) {
+            for (RowId r = partition.offsets[c] + 1; r < partition.offsets[c + 1]; r++) {
+                uint64_t gap = partition.rows[r] - partition.rows[r - 1] - 1;
+                maxBlocks += gap > UINT32_MAX;
+            }
+        }
+    }
+
+    CompressedPartition packed;
+    packed.rows = rows;
+    packed.sumCLogC = partition.sumCLogC;
+    packed.classBlocks = allocateArray<RowId>(classes + 1, arena, node);
+    packed.blocks = allocateArray<PackedBlock>(maxBlocks, arena, node);
+    // Allocated last so the arena can take back what isn't used
+    size_t maxWords = rows + maxBlocks + 1;
+    packed.words = allocateArray<uint32_t>(maxWords, arena, node);
+
+    RowId word = 0;
+    for (size_t c = 0; c < classes; c++) {
+        packed.classBlocks.push_back((RowId)packed.blocks.size());
+        const RowId *tids = partition.rows.data() + partition.offsets[c];
+        size_t count = partition.offsets[c + 1] - partition.offsets[c];
+        uint32_t widest;
+        for (size_t start = 0, n; start < count; start += n) {
+            n = packedBlockLength(tids + start, count - start, widest);
+            const RowId *block = tids + start;
+            int bits = widest == 0 ? 0 : 32 - __builtin_clz(widest);
+            packed.blocks.push_back({block[0], word, (uint16_t)n, (uint8_t)bits});
+
+            uint64_t buffer = 0;
+            int filled = 0;
+            for (size_t i = 1; i < n && bits > 0; i++) {
+                buffer |= (uint64_t)(block[i] - block[i - 1] - 1) << filled;
+                filled += bits;
+                if (filled >= 32) {
+                    packed.words[word++] = (uint32_t)buffer;
+                    buffer >>= 32;
+                    filled -= 32;
+                }
+            }
+            if (filled > 0) {
+                packed.words[word++] = (uint32_t)buffer;
+            }
+        }
+    }
+    if (classes > 0) {
+        packed.classBlocks.push_back((RowId)packed.blocks.size());
+    }
+    packed.words[word++] = 0;
+    packed.words.resize(word);
+    if (arena != nullptr) {
+        arena->trim(packed.words.data(), word * sizeof(uint32_t));
+    }
+    return packed;
+}
+
+// Writes the block's TIDs to out, which has room for PACKED_BLOCK_ROWS
+inline void decodeBlock(const CompressedPartition &packed, const PackedBlock &block, RowId *out) {
+    out[0] = block.base;
+    RowId *gaps = out + 1;
+    size_t n = block.count - 1;
+
+    if (block.bits == 0) {
+        std::fill(gaps, gaps + n, 0);
+    } else {
+        const uint32_t *words = packed.words.data() + block.offset;
+        uint32_t mask = block.bits == 32 ? ~0u : (1u << block.bits) - 1;
+        size_t bit = 0;
+        for (size_t i = 0; i < n; i++, bit += block.bits) {
+            // The padding word keeps this read in bounds
+            uint64_t window = words[bit >> 5] | (uint64_t)words[(bit >> 5) + 1] << 32;
+            gaps[i] = (uint32_t)(window >> (bit & 31)) & mask;
+        }
+    }
+
+    size_t i = 0;
+    RowId previous = block.base;
+#if defined(__SSE2__)
+    if (sizeof(RowId) == sizeof(uint32_t)) {
+        __m128i carry = _mm_set1_epi32((int)previous);
+        const __m128i ones = _mm_set1_epi32(1);
+        for (; i + 4 <= n; i += 4) {
+            __m128i v = _mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(gaps + i)), ones);
+            v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+            v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+            v = _mm_add_epi32(v, carry);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(gaps + i), v);
+            carry = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 3));
+        }
+        previous = (uint32_t)_mm_cvtsi128_si32(carry);
+    }
+#endif
+    for (; i < n; i++) {
+        previous += gaps[i] + 1;
+        gaps[i] = previous;
+    }
+}
+
+// Decodes class c into out, returning its size; out is grown as needed
+inline size_t decodeClass(const CompressedPartition &packed, size_t c, std::vector<RowId> &out) {
+    size_t count = 0;
+    for (RowId b = packed.classBlocks[c]; b < packed.classBlocks[c + 1]; b++) {
+        count += packed.blocks[b].count;
+    }
+    if (out.size() < count) {
+        out.resize(count);
+    }
+    size_t filled = 0;
+    for (RowId b = packed.classBlocks[c]; b < packed.classBlocks[c + 1]; b++) {
+        decodeBlock(packed, packed.blocks[b], out.data() + filled);
+        filled += packed.blocks[b].count;
+    }
+    return count;
+}
+
+inline StrippedPartition decompressPartition(const CompressedPartition &packed, Arena *arena = nullptr) {
+    StrippedPartition partition = allocatePartition(packed.rowCount(), arena);
+    RowId out = 0;
+    for (size_t c = 0; c < packed.classCount(); c++) {
+        partition.offsets.push_back(out);
+        for (RowId b = packed.classBlocks[c]; b < packed.classBlocks[c + 1]; b++) {
+            decodeBlock(packed, packed.blocks[b], partition.rows.data() + out);
+            out += packed.blocks[b].count;
+        }
+    }
+    if (out > 0) {
+        partition.offsets.push_back(out);
+    }
+    partition.rows.resize(out);
+    packPartition(partition, arena);
+    return partition;
+}
+
+// refinePartition() for a compressed parent: each class is decoded into a
+// per-thread buffer and split from there
+inline StrippedPartition refinePartition(const CompressedPartition &parent, const uint32_t *codes, uint32_t cardinality, Arena *arena = nullptr) {
+    static thread_local std::vector<RowId> decoded;
+    RefineScratch &scratch = refineScratch(cardinality);
+    StrippedPartition partition = allocatePartition(parent.rowCount(), arena);
+    RowId out = 0;
+    for (size_t c = 0; c < parent.classCount(); c++) {
+        size_t count = decodeClass(parent, c, decoded);
+        refineClass(decoded.data(), decoded.data() + count, codes, scratch, partition, out);
+    }
+    if (out > 0) {
+        partition.offsets.push_back(out);
+    }
+    partition.sumCLogC = sumClassCLogC(partition.offsets.data(), partition.classCount()).value();
+    partition.rows.resize(out);
+    packPartition(partition, arena);
+    return partition;
+}
+
+#endif // COMPRESSED_PARTITION_HPP
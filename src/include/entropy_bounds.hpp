@@ -0,0 +1,115 @@
+#ifndef ENTROPY_BOUNDS_HPP
+#define ENTROPY_BOUNDS_HPP
+
+#include "attribute_set.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+// Interval known to contain an entropy; exact when both ends meet
+struct EntropyInterval {
+    double lower = 0;
+    double upper = std::numeric_limits<double>::infinity();
+
+    bool exact() const {
+        return lower == upper;
+    }
+};
+
+// Bounds on entropies that have not been computed, from those that have.
+// Entropy is monotone and submodular, so for Z and a, b in Z:
+//
+//   H(Z) >= H(Z - a)
+//   H(Z) <= H(Z - a) + H(a)
+//   H(Z) <= H(Z - a) + H(Z - b) - H(Z - a - b)
+//
+// and H(Z) <= log2(N). Subsets that are not known are bounded the same way,
+// recursing `depth` levels down from Z; below that, only the known single
+// attributes in a set bound it.
+template <int Words>
+class EntropyBounds {
+public:
+    using AttributeSet = AttributeMask<Words>;
+    using Lookup = std::function<bool(const AttributeSet &, double &)>;
+
+private:
+    Lookup lookup;
+    double maxEntropy;
+    std::unordered_map<AttributeSet, EntropyInterval, AttributeMaskHash<Words>> memo;
+
+    EntropyInterval single(int att) {
+        EntropyInterval interval;
+        interval.upper = maxEntropy;
+        double entropy;
+        if (lookup(AttributeSet{att}, entropy)) {
+            interval.lower = interval.upper = entropy;
+        }
+        return interval;
+    }
+
+    EntropyInterval boundsAt(const AttributeSet &attSet, int depth) {
+        auto found = memo.find(attSet);
+        if (found != memo.end()) {
+            return found->second;
+        }
+        EntropyInterval interval;
+        double entropy;
+        if (attSet.empty()) {
+            interval.lower = interval.upper = 0;
+        } else if (lookup(attSet, entropy)) {
+            interval.lower = interval.upper = entropy;
+        } else {
+            interval.upper = maxEntropy;
+            double singles = 0;
+            for (int att : attSet) {
+                EntropyInterval one = single(att);
+                interval.lower = std::max(interval.lower, one.lower);
+                singles += one.upper;
+            }
+            interval.upper = std::min(interval.upper, singles);
+
+            if (depth > 0 && attSet.size() > 1) {
+                std::vector<EntropyInterval> without;
+                for (int att : attSet) {
+                    AttributeSet rest = attSet;
+                    rest.erase(att);
+                    EntropyInterval sub = boundsAt(rest, depth - 1);
+                    interval.lower = std::max(interval.lower, sub.lower);
+                    interval.upper = std::min(interval.upper, sub.upper + single(att).upper);
+                    without.push_back(sub);
+                }
+                if (depth > 1 && attSet.size() > 2) {
+                    std::vector<int> atts(attSet.begin(), attSet.end());
+                    for (size_t a = 0; a < atts.size(); a++) {
+                        for (size_t b = a + 1; b < atts.size(); b++) {
+                            AttributeSet rest = attSet;
+                            rest.erase(atts[a]);
+                            rest.erase(atts[b]);
+                            double common = boundsAt(rest, depth - 2).lower;
+                            interval.upper = std::min(interval.upper, without[a].upper + without[b].upper - common);
+                        }
+                    }
+                }
+            }
+            // Rounding in the known entropies must not cross the ends over
+            interval.upper = std::max(interval.upper, interval.lower);
+        }
+        memo[attSet] = interval;
+        return interval;
+    }
+
+public:
+    // lookup finds computed entropies; maxEntropy is log2 of the row count
+    EntropyBounds(Lookup lookup, double maxEntropy) : lookup(std::move(lookup)), maxEntropy(maxEntropy) {}
+
+    // Each call starts from the entropies lookup finds at that point
+    EntropyInterval bounds(const AttributeSet &attSet, int depth = 2) {
+        memo.clear();
+        return boundsAt(attSet, depth);
+    }
+};
+
+#endif // ENTROPY_BOUNDS_HPP
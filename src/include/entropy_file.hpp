@@ -0,0 +1,529 @@
+#ifndef ENTROPY_FILE_HPP
+#define ENTROPY_FILE_HPP
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Binary, mmap-able store of mined entropies.
+//
+// Keys are placed with a minimal perfect hash in the style of PTHash: keys
+// hash to buckets of about four, and buckets, largest first, each search for
+// a pilot value that sends all of their keys to free slots of a table slightly
+// larger than the key count. Slots past the key count are then remapped into
+// the holes below it, so keys and values are stored densely with no empty
+// slots. The keys themselves are kept so lookups of sets that were never mined
+// fail rather than returning another set's entropy.
+//
+// Values can be quantized. Entropies lie in [0, log2 N], so the 16-bit format
+// stores them as fractions of log2 N. The header records a fingerprint of the
+// source data, so consumers can tell a store is stale.
+//
+// Supersets of a key are keys too and are not stored, as in EntropyStore; the
+// minimal keys follow the values, grouped by lowest attribute, and a lookup
+// that misses the table checks the groups of the set's attributes.
+
+enum class EntropyQuantization : uint32_t {
+    Float64 = 0,
+    Float32 = 1,
+    Fixed16 = 2
+};
+
+struct EntropyFileHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t keyWords;
+    uint32_t attributeCount;
+    uint32_t quantization;
+    uint64_t tupleCount;
+    uint64_t entryCount;
+    uint64_t tableSize;
+    uint64_t bucketCount;
+    uint64_t seed;
+    uint64_t fingerprint;
+    double scale;
+    uint64_t pilotsOffset;
+    uint64_t remapOffset;
+    uint64_t keysOffset;
+    uint64_t valuesOffset;
+    uint64_t minimalKeyCount;
+    uint64_t emptyKey;           // 1 if the empty set is a key, so every set is
+    double keyEntropy;           // log2 N
+    uint64_t keyBucketsOffset;   // attributeCount + 1 indices into the minimal keys
+    uint64_t minimalKeysOffset;
+};
+
+const uint64_t ENTROPY_FILE_MAGIC = 0x504f52544e45494dULL; // "MIENTROP"
+const uint32_t ENTROPY_FILE_VERSION = 2;
+
+inline uint64_t mixBits(uint64_t x) {
+    // splitmix64 finalizer
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+inline uint64_t hashKeyWords(const uint64_t *words, int count, uint64_t seed) {
+    uint64_t h = mixBits(seed);
+    for (int w = 0; w < count; w++) {
+        h = mixBits(h ^ words[w]);
+    }
+    return h;
+}
+
+// Hash of a file's size and contents, read in 1 MB chunks
+inline uint64_t datasetFingerprint(const std::string &path) {
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return 0;
+    }
+    std::vector<unsigned char> buffer(1 << 20);
+    uint64_t h = 0xcbf29ce484222325ULL;
+    uint64_t total = 0;
+    size_t read;
+    while ((read = std::fread(buffer.data(), 1, buffer.size(), file)) > 0) {
+        size_t i = 0;
+        for (; i + 8 <= read; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, buffer.data() + i, 8);
+            h = mixBits(h ^ word);
+        }
+        for (; i < read; i++) {
+            h = mixBits(h ^ buffer[i]);
+        }
+        total += read;
+    }
+    std::fclose(file);
+    return mixBits(h ^ total);
+}
+
+template <typename Key>
+class EntropyFileWriter {
+private:
+    static constexpr int WORDS = sizeof(Key) / sizeof(uint64_t);
+    static constexpr double LOAD_FACTOR = 0.98;
+    static constexpr uint32_t MAX_PILOT = 1u << 22;
+
+    struct Layout {
+        uint64_t seed;
+        uint64_t tableSize;
+        std::vector<uint32_t> pilots;
+        std::vector<uint32_t> remap;
+        std::vector<uint32_t> slotOf;   // Entry index -> final slot
+    };
+
+    static std::vector<uint64_t> keyWords(const Key &key) {
+        std::vector<uint64_t> words(WORDS);
+        for (int w = 0; w < WORDS; w++) {
+            words[w] = key.word(w);
+        }
+        return words;
+    }
+
+    static bool tryBuild(const std::vector<std::pair<Key, double>> &entries, uint64_t seed, Layout &layout) {
+        uint64_t n = entries.size();
+        uint64_t m = std::max<uint64_t>(n, (uint64_t)std::ceil(n / LOAD_FACTOR));
+        uint64_t buckets = std::max<uint64_t>(1, (n + 3) / 4);
+
+        std::vector<uint64_t> hashes(n);
+        std::vector<uint32_t> bucketOf(n);
+        std::vector<uint32_t> bucketSize(buckets, 0);
+        for (uint64_t i = 0; i < n; i++) {
+            hashes[i] = hashKeyWords(keyWords(entries[i].first).data(), WORDS, seed);
+            bucketOf[i] = (uint32_t)(((hashes[i] >> 32) * buckets) >> 32);
+            bucketSize[bucketOf[i]]++;
+        }
+
+        // Keys grouped by bucket
+        std::vector<uint64_t> bucketStart(buckets + 1, 0);
+        for (uint64_t b = 0; b < buckets; b++) {
+            bucketStart[b + 1] = bucketStart[b] + bucketSize[b];
+        }
+        std::vector<uint32_t> members(n);
+        std::vector<uint64_t> fill(bucketStart.begin(), bucketStart.end() - 1);
+        for (uint64_t i = 0; i < n; i++) {
+            members[fill[bucketOf[i]]++] = (uint32_t)i;
+        }
+
+        std::vector<uint32_t> order(buckets);
+        for (uint64_t b = 0; b < buckets; b++) {
+            order[b] = (uint32_t)b;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return bucketSize[a] > bucketSize[b];
+        });
+
+        std::vector<bool> taken(m, false);
+        std::vector<uint64_t> positions;
+        std::vector<uint32_t> slotOf(n);
+        layout.pilots.assign(buckets, 0);
+        for (uint32_t b : order) {
+            if (bucketSize[b] == 0) {
+                break;
+            }
+            uint32_t pilot = 0;
+            for (; pilot < MAX_PILOT; pilot++) {
+                uint64_t pilotHash = mixBits(pilot);
+                positions.clear();
+                bool fits = true;
+                for (uint64_t k = bucketStart[b]; k < bucketStart[b + 1] && fits; k++) {
+                    uint64_t pos = (hashes[members[k]] ^ pilotHash) % m;
+                    fits = !taken[pos] && std::find(positions.begin(), positions.end(), pos) == positions.end();
+                    positions.push_back(pos);
+                }
+                if (fits) {
+                    break;
+                }
+            }
+            if (pilot == MAX_PILOT) {
+                return false;
+            }
+            layout.pilots[b] = pilot;
+            for (uint64_t k = bucketStart[b]; k < bucketStart[b + 1]; k++) {
+                uint64_t pos = positions[k - bucketStart[b]];
+                taken[pos] = true;
+                slotOf[members[k]] = (uint32_t)pos;
+            }
+        }
+
+        // Move keys that landed past n into the holes below n
+        layout.remap.assign(m - n, 0);
+        uint64_t hole = 0;
+        for (uint64_t i = 0; i < n; i++) {
+            if (slotOf[i] >= n) {
+                while (taken[hole]) {
+                    hole++;
+                }
+                taken[hole] = true;
+                layout.remap[slotOf[i] - n] = (uint32_t)hole;
+                slotOf[i] = (uint32_t)hole;
+            }
+        }
+
+        layout.seed = seed;
+        layout.tableSize = m;
+        layout.slotOf = std::move(slotOf);
+        return true;
+    }
+
+    static bool writeAt(FILE *file, uint64_t offset, const void *data, size_t bytes) {
+        if (fseeko(file, (off_t)offset, SEEK_SET) != 0) {
+            return false;
+        }
+        return bytes == 0 || std::fwrite(data, 1, bytes, file) == bytes;
+    }
+
+    static uint64_t align(uint64_t offset) {
+        return (offset + 7) & ~7ULL;
+    }
+
+public:
+    // minimalKeys are the relation's minimal keys; every entry that contains
+    // one reads back with entropy log2(tupleCount)
+    static void write(const std::string &path, const std::vector<std::pair<Key, double>> &entries, const std::vector<Key> &minimalKeys,
+                      int attributeCount, uint64_t tupleCount, uint64_t fingerprint,
+                      EntropyQuantization quantization = EntropyQuantization::Float64) {
+        Layout layout;
+        uint64_t seed = 0x5eed;
+        while (!tryBuild(entries, seed, layout)) {
+            seed = mixBits(seed);
+        }
+
+        uint64_t n = entries.size();
+        EntropyFileHeader header = {};
+        header.magic = ENTROPY_FILE_MAGIC;
+        header.version = ENTROPY_FILE_VERSION;
+        header.keyWords = WORDS;
+        header.attributeCount = attributeCount;
+        header.quantization = (uint32_t)quantization;
+        header.tupleCount = tupleCount;
+        header.entryCount = n;
+        header.tableSize = layout.tableSize;
+        header.bucketCount = layout.pilots.size();
+        header.seed = layout.seed;
+        header.fingerprint = fingerprint;
+        header.scale = tupleCount > 1 ? std::log2((double)tupleCount) : 1.0;
+        header.pilotsOffset = align(sizeof(header));
+        header.remapOffset = align(header.pilotsOffset + layout.pilots.size() * sizeof(uint32_t));
+        header.keysOffset = align(header.remapOffset + layout.remap.size() * sizeof(uint32_t));
+        header.valuesOffset = header.keysOffset + n * WORDS * sizeof(uint64_t);
+
+        std::vector<Key> sortedKeys;
+        for (const Key &key : minimalKeys) {
+            if (key.empty()) {
+                header.emptyKey = 1;
+            } else {
+                sortedKeys.push_back(key);
+            }
+        }
+        std::stable_sort(sortedKeys.begin(), sortedKeys.end(), [](const Key &a, const Key &b) {
+            return a.first() < b.first();
+        });
+        std::vector<uint64_t> keyBuckets(attributeCount + 1, 0);
+        for (const Key &key : sortedKeys) {
+            keyBuckets[key.first() + 1]++;
+        }
+        for (int a = 0; a < attributeCount; a++) {
+            keyBuckets[a + 1] += keyBuckets[a];
+        }
+        std::vector<uint64_t> minimalKeyWords;
+        for (const Key &key : sortedKeys) {
+            for (int w = 0; w < WORDS; w++) {
+                minimalKeyWords.push_back(key.word(w));
+            }
+        }
+        header.minimalKeyCount = sortedKeys.size();
+        header.keyEntropy = tupleCount > 0 ? std::log2((double)tupleCount) : 0.0;
+
+        std::vector<uint64_t> keys(n * WORDS);
+        std::vector<unsigned char> values;
+        size_t valueBytes = quantization == EntropyQuantization::Float64 ? 8 : quantization == EntropyQuantization::Float32 ? 4 : 2;
+        values.resize(n * valueBytes);
+        for (uint64_t i = 0; i < n; i++) {
+            uint64_t slot = layout.slotOf[i];
+            for (int w = 0; w < WORDS; w++) {
+                keys[slot * WORDS + w] = entries[i].first.word(w);
+            }
+            double value = entries[i].second;
+            unsigned char *out = values.data() + slot * valueBytes;
+            if (quantization == EntropyQuantization::Float64) {
+                std::memcpy(out, &value, 8);
+            } else if (quantization == EntropyQuantization::Float32) {
+                float f = (float)value;
+                std::memcpy(out, &f, 4);
+            } else {
+                double q = std::round(std::min(std::max(value / header.scale, 0.0), 1.0) * 65535.0);
+                uint16_t fixed = (uint16_t)q;
+                std::memcpy(out, &fixed, 2);
+            }
+        }
+        header.keyBucketsOffset = align(header.valuesOffset + values.size());
+        header.minimalKeysOffset = header.keyBucketsOffset + keyBuckets.size() * sizeof(uint64_t);
+
+        std::string tmpPath = path + ".tmp";
+        FILE *file = std::fopen(tmpPath.c_str(), "wb");
+        if (file == nullptr) {
+            throw std::runtime_error("Could not create entropy file " + tmpPath);
+        }
+        // Synced before the rename, so a failed write never replaces a good file
+        bool written = writeAt(file, 0, &header, sizeof(header)) &&
+            writeAt(file, header.pilotsOffset, layout.pilots.data(), layout.pilots.size() * sizeof(uint32_t)) &&
+            writeAt(file, header.remapOffset, layout.remap.data(), layout.remap.size() * sizeof(uint32_t)) &&
+            writeAt(file, header.keysOffset, keys.data(), keys.size() * sizeof(uint64_t)) &&
+            writeAt(file, header.valuesOffset, values.data(), values.size()) &&
+            writeAt(file, header.keyBucketsOffset, keyBuckets.data(), keyBuckets.size() * sizeof(uint64_t)) &&
+            writeAt(file, header.minimalKeysOffset, minimalKeyWords.data(), minimalKeyWords.size() * sizeof(uint64_t)) &&
+            !std::ferror(file) && std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+        if (std::fclose(file) != 0 || !written || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+            std::remove(tmpPath.c_str());
+            throw std::runtime_error("Could not write entropy file " + path);
+        }
+    }
+};
+
+// Read-only view of an entropy file. Nothing is loaded up front: a lookup
+// touches one pilot, at most one remap entry, one key and one value.
+template <typename Key>
+class EntropyFileReader {
+private:
+    static constexpr int WORDS = sizeof(Key) / sizeof(uint64_t);
+
+    std::shared_ptr<void> mapping;
+    const EntropyFileHeader *header;
+    const uint32_t *pilots;
+    const uint32_t *remap;
+    const uint64_t *keys;
+    const unsigned char *values;
+    const uint64_t *keyBuckets;
+    const uint64_t *minimalKeys;
+
+    double decode(uint64_t slot) const {
+        switch ((EntropyQuantization)header->quantization) {
+        case EntropyQuantization::Float64: {
+            double value;
+            std::memcpy(&value, values + slot * 8, 8);
+            return value;
+        }
+        case EntropyQuantization::Float32: {
+            float value;
+            std::memcpy(&value, values + slot * 4, 4);
+            return value;
+        }
+        default: {
+            uint16_t fixed;
+            std::memcpy(&fixed, values + slot * 2, 2);
+            return fixed / 65535.0 * header->scale;
+        }
+        }
+    }
+
+    // Whether `count` items of `itemBytes` at offset lie inside the file
+    static bool sectionFits(uint64_t offset, uint64_t count, uint64_t itemBytes, uint64_t bytes, uint64_t alignment) {
+        return offset % alignment == 0 && offset <= bytes && count <= (bytes - offset) / itemBytes;
+    }
+
+    static bool validLayout(const EntropyFileHeader &header, uint64_t bytes) {
+        if (header.quantization > (uint32_t)EntropyQuantization::Fixed16 || header.tableSize < header.entryCount ||
+            header.bucketCount > ((uint64_t)1 << 32) || (header.entryCount > 0 && header.bucketCount == 0)) {
+            return false;
+        }
+        uint64_t valueBytes = header.quantization == (uint32_t)EntropyQuantization::Float64 ? 8 :
+            header.quantization == (uint32_t)EntropyQuantization::Float32 ? 4 : 2;
+        return sectionFits(header.pilotsOffset, header.bucketCount, sizeof(uint32_t), bytes, alignof(uint32_t)) &&
+            sectionFits(header.remapOffset, header.tableSize - header.entryCount, sizeof(uint32_t), bytes, alignof(uint32_t)) &&
+            sectionFits(header.keysOffset, header.entryCount, WORDS * sizeof(uint64_t), bytes, alignof(uint64_t)) &&
+            sectionFits(header.valuesOffset, header.entryCount, valueBytes, bytes, 1) &&
+            sectionFits(header.keyBucketsOffset, (uint64_t)header.attributeCount + 1, sizeof(uint64_t), bytes, alignof(uint64_t)) &&
+            sectionFits(header.minimalKeysOffset, header.minimalKeyCount, WORDS * sizeof(uint64_t), bytes, alignof(uint64_t));
+    }
+
+    // Bucket bounds must rise from 0 to the key count
+    bool validKeyBuckets() const {
+        uint64_t previous = 0;
+        for (uint32_t a = 0; a <= header->attributeCount; a++) {
+            if (keyBuckets[a] < previous || keyBuckets[a] > header->minimalKeyCount) {
+                return false;
+            }
+            previous = keyBuckets[a];
+        }
+        return previous == header->minimalKeyCount;
+    }
+
+    bool findEntry(const uint64_t *words, double &entropy) const {
+        if (header->entryCount == 0) {
+            return false;
+        }
+        uint64_t h = hashKeyWords(words, WORDS, header->seed);
+        uint64_t bucket = ((h >> 32) * header->bucketCount) >> 32;
+        uint64_t slot = (h ^ mixBits(pilots[bucket])) % header->tableSize;
+        if (slot >= header->entryCount) {
+            slot = remap[slot - header->entryCount];
+            if (slot >= header->entryCount) {
+                return false; // Corrupt remap entry
+            }
+        }
+        if (std::memcmp(keys + slot * WORDS, words, WORDS * sizeof(uint64_t)) != 0) {
+            return false;
+        }
+        entropy = decode(slot);
+        return true;
+    }
+
+    // A minimal key inside key has its lowest attribute in key
+    bool coveredByKey(const Key &key, const uint64_t *words) const {
+        if (header->emptyKey) {
+            return true;
+        }
+        for (int att : key) {
+            if (att >= (int)header->attributeCount) {
+                break;
+            }
+            for (uint64_t k = keyBuckets[att]; k < keyBuckets[att + 1]; k++) {
+                const uint64_t *member = minimalKeys + k * WORDS;
+                bool inside = true;
+                for (int w = 0; w < WORDS && inside; w++) {
+                    inside = (member[w] & ~words[w]) == 0;
+                }
+                if (inside) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+public:
+    explicit EntropyFileReader(const std::string &path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            throw std::runtime_error("Could not open entropy file " + path);
+        }
+        size_t bytes = info.st_size;
+        void *ptr = bytes == 0 ? MAP_FAILED : mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (ptr == MAP_FAILED) {
+            throw std::runtime_error("Could not map entropy file " + path);
+        }
+        mapping = std::shared_ptr<void>(ptr, [bytes](void *p) { munmap(p, bytes); });
+
+        const unsigned char *base = static_cast<const unsigned char *>(ptr);
+        header = reinterpret_cast<const EntropyFileHeader *>(base);
+        if (bytes < sizeof(EntropyFileHeader) || header->magic != ENTROPY_FILE_MAGIC ||
+            header->version != ENTROPY_FILE_VERSION || header->keyWords != (uint32_t)WORDS) {
+            throw std::runtime_error("Not an entropy file for this lattice width: " + path);
+        }
+        if (!validLayout(*header, bytes)) {
+            throw std::runtime_error("Truncated or corrupt entropy file " + path);
+        }
+        pilots = reinterpret_cast<const uint32_t *>(base + header->pilotsOffset);
+        remap = reinterpret_cast<const uint32_t *>(base + header->remapOffset);
+        keys = reinterpret_cast<const uint64_t *>(base + header->keysOffset);
+        values = base + header->valuesOffset;
+        keyBuckets = reinterpret_cast<const uint64_t *>(base + header->keyBucketsOffset);
+        minimalKeys = reinterpret_cast<const uint64_t *>(base + header->minimalKeysOffset);
+        if (!validKeyBuckets()) {
+            throw std::runtime_error("Truncated or corrupt entropy file " + path);
+        }
+    }
+
+    uint64_t size() const {
+        return header->entryCount;
+    }
+
+    uint64_t fingerprint() const {
+        return header->fingerprint;
+    }
+
+    int attributeCount() const {
+        return header->attributeCount;
+    }
+
+    uint64_t tupleCount() const {
+        return header->tupleCount;
+    }
+
+    // Sets containing a minimal key are found too, with entropy log2 N
+    bool find(const Key &key, double &entropy) const {
+        uint64_t words[WORDS];
+        for (int w = 0; w < WORDS; w++) {
+            words[w] = key.word(w);
+        }
+        if (findEntry(words, entropy)) {
+            return true;
+        }
+        if (!coveredByKey(key, words)) {
+            return false;
+        }
+        entropy = header->keyEntropy;
+        return true;
+    }
+
+    // Visits the stored entries only, not the supersets of keys
+    template <typename F>
+    void forEach(F fn) const {
+        for (uint64_t slot = 0; slot < header->entryCount; slot++) {
+            fn(Key::fromWords(keys + slot * WORDS), decode(slot));
+        }
+    }
+};
+
+#endif // ENTROPY_FILE_HPP
@@ -0,0 +1,154 @@
+#ifndef ENTROPY_KERNEL_HPP
+#define ENTROPY_KERNEL_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Σ c·log2(c) over the group counts of a partition, the quantity every
+// entropy is derived from. Counts below CLOGC_TABLE_SIZE, which is where
+// almost all groups fall, come from a table; larger ones are batched and
+// run through a 2-lane SSE2 log2. Counts of 0 and 1 contribute nothing, so
+// spans may include them.
+//
+// Sums are kept in fixed point: every term is rounded once to a multiple of
+// 2^-32 and added as an integer. Integer addition is exact, so partial sums
+// over any split of the groups, taken on any number of threads and folded
+// in any order, come to the same bits.
+
+const size_t CLOGC_TABLE_SIZE = 4096;  // 32 KB of fixed-point terms, fits in L1
+const size_t CLOGC_BATCH = 64;
+
+class CLogCSum {
+public:
+    static constexpr double UNIT = 4294967296.0;  // 2^32 units per bit
+
+    // Up to 2^95 bits: c·log2(c) summed over 2^64 rows is below 2^71
+    __int128 units = 0;
+
+    static __int128 toUnits(double term) {
+        return (__int128)std::nearbyint(term * UNIT);
+    }
+
+    void addTerm(double term) {
+        units += toUnits(term);
+    }
+
+    CLogCSum &operator+=(const CLogCSum &other) {
+        units += other.units;
+        return *this;
+    }
+
+    double value() const {
+        return (double)units / UNIT;
+    }
+};
+
+inline const int64_t *cLogCTable() {
+    static const int64_t *table = [] {
+        static int64_t units[CLOGC_TABLE_SIZE];
+        units[0] = 0;
+        for (size_t c = 1; c < CLOGC_TABLE_SIZE; c++) {
+            units[c] = (int64_t)CLogCSum::toUnits(c * std::log2((double)c));
+        }
+        return units;
+    }();
+    return table;
+}
+
+#if defined(__SSE2__)
+// log2 of two positive, normal doubles: x = m·2^e with m in [√½, √2), and
+// log2(m) = 2·atanh(s) / ln 2 for s = (m - 1) / (m + 1), |s| < 0.172. The
+// atanh series is cut after s^21, below double precision.
+inline __m128d log2Pair(__m128d x) {
+    const __m128i mantissaMask = _mm_set1_epi64x(0x000fffffffffffffLL);
+    const __m128i one = _mm_castpd_si128(_mm_set1_pd(1.0));
+    __m128i bits = _mm_castpd_si128(x);
+    __m128i biased = _mm_srli_epi64(bits, 52);
+    __m128d e = _mm_sub_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(biased, _MM_SHUFFLE(2, 0, 2, 0))), _mm_set1_pd(1023.0));
+    __m128d m = _mm_castsi128_pd(_mm_or_si128(_mm_and_si128(bits, mantissaMask), one));
+
+    __m128d high = _mm_cmpgt_pd(m, _mm_set1_pd(1.4142135623730951));
+    m = _mm_or_pd(_mm_and_pd(high, _mm_mul_pd(m, _mm_set1_pd(0.5))), _mm_andnot_pd(high, m));
+    e = _mm_add_pd(e, _mm_and_pd(high, _mm_set1_pd(1.0)));
+
+    __m128d s = _mm_div_pd(_mm_sub_pd(m, _mm_set1_pd(1.0)), _mm_add_pd(m, _mm_set1_pd(1.0)));
+    __m128d z = _mm_mul_pd(s, s);
+    __m128d p = _mm_set1_pd(1.0 / 21);
+    for (int k = 9; k >= 0; k--) {
+        p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(1.0 / (2 * k + 1)));
+    }
+    // 2 / ln 2
+    __m128d lnScale = _mm_set1_pd(2.8853900817779268);
+    return _mm_add_pd(e, _mm_mul_pd(_mm_mul_pd(s, p), lnScale));
+}
+#endif
+
+// Adds c·log2(c) for n counts, all at least CLOGC_TABLE_SIZE. Each term is
+// computed the same way whatever its position, so batching never changes it.
+inline void sumLargeCLogC(const double *counts, size_t n, CLogCSum &sum) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    double terms[2];
+    for (; i < n; i += 2) {
+        // An odd tail is padded with a count of 1, whose term is exactly 0
+        __m128d c = _mm_set_pd(i + 1 < n ? counts[i + 1] : 1.0, counts[i]);
+        _mm_storeu_pd(terms, _mm_mul_pd(c, log2Pair(c)));
+        sum.addTerm(terms[0]);
+        sum.addTerm(terms[1]);
+    }
+#endif
+    for (; i < n; i++) {
+        sum.addTerm(counts[i] * std::log2(counts[i]));
+    }
+}
+
+inline double cLogC(uint64_t c) {
+    if (c < CLOGC_TABLE_SIZE) {
+        return cLogCTable()[c] / CLogCSum::UNIT;
+    }
+    return (double)c * std::log2((double)c);
+}
+
+// Σ c·log2(c) over count(0), ..., count(n - 1)
+template <typename CountAt>
+CLogCSum sumCLogCWith(size_t n, CountAt count) {
+    const int64_t *table = cLogCTable();
+    __int128 small[4] = {0, 0, 0, 0};
+    CLogCSum sum;
+    double batch[CLOGC_BATCH];
+    size_t batched = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t c = count(i);
+        if (c < CLOGC_TABLE_SIZE) {
+            small[i & 3] += table[c];
+            continue;
+        }
+        batch[batched++] = (double)c;
+        if (batched == CLOGC_BATCH) {
+            sumLargeCLogC(batch, batched, sum);
+            batched = 0;
+        }
+    }
+    sumLargeCLogC(batch, batched, sum);
+    sum.units += small[0] + small[1] + small[2] + small[3];
+    return sum;
+}
+
+template <typename Count>
+CLogCSum sumCLogC(const Count *counts, size_t n) {
+    return sumCLogCWith(n, [counts](size_t i) { return (uint64_t)counts[i]; });
+}
+
+// Σ c·log2(c) over the classes of a partition given its class offsets: class
+// i has offsets[i + 1] - offsets[i] rows
+template <typename Offset>
+CLogCSum sumClassCLogC(const Offset *offsets, size_t classes) {
+    return sumCLogCWith(classes, [offsets](size_t i) { return (uint64_t)(offsets[i + 1] - offsets[i]); });
+}
+
+#endif // ENTROPY_KERNEL_HPP
@@ -0,0 +1,596 @@
+#ifndef ENTROPY_STORE_HPP
+#define ENTROPY_STORE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "numa.hpp"
+
+// Open-addressing table from attribute bitmask to entropy with lock-free
+// lookups.
+//
+// A slot is claimed with a CAS on its state, its key written and the slot
+// published; values are stored as the bits of a double, so inserts, BUC-style
+// accumulation and lookups may all run concurrently. Keys wider than a word
+// can't be swapped atomically, so a reader that meets a slot mid-claim waits
+// the few instructions it takes to publish it.
+//
+// The table doubles once it is half full. Readers never lock or write shared
+// memory: they follow an atomic pointer to the current table. Writers
+// announce themselves in per-thread striped counters, and growth waits for
+// those to drain, copies the entries and publishes the new table. Replaced
+// tables stay mapped, for readers still probing them, until clear() or
+// destruction, which at most doubles the footprint.
+template <typename Key>
+class ConcurrentEntropyStore {
+private:
+    enum SlotState : uint32_t { EMPTY = 0, CLAIMING = 1, READY = 2 };
+
+    // Quiet NaN payload marking a published slot whose value isn't written yet
+    static constexpr uint64_t UNSET_VALUE = 0x7ff8dead00000000ULL;
+
+    static constexpr int WRITER_STRIPES = 64;
+
+    struct Slot {
+        std::atomic<uint32_t> state;
+        Key key;
+        std::atomic<uint64_t> value;
+    };
+
+    struct Table {
+        std::unique_ptr<Slot[]> slots;
+        size_t mask;
+
+        // Empty table of `size` slots, a power of two
+        explicit Table(size_t size) : slots(new Slot[size]), mask(size - 1) {
+            for (size_t i = 0; i <= mask; i++) {
+                slots[i].state.store(EMPTY, std::memory_order_relaxed);
+                slots[i].value.store(UNSET_VALUE, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    struct alignas(64) WriterStripe {
+        std::atomic<int> active{0};
+    };
+
+    std::atomic<Table *> current;
+    std::vector<std::unique_ptr<Table>> tables;  // Current one last
+    std::atomic<size_t> count;
+
+    std::unique_ptr<WriterStripe[]> writers;
+    std::atomic<bool> growing{false};
+    std::mutex growLock;
+
+    static uint64_t toBits(double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    static double fromBits(uint64_t bits) {
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    static uint32_t waitReady(const Slot &slot) {
+        uint32_t state;
+        while ((state = slot.state.load(std::memory_order_acquire)) == CLAIMING) {
+            std::this_thread::yield();
+        }
+        return state;
+    }
+
+    static int writerStripe() {
+        static std::atomic<int> nextStripe{0};
+        static thread_local int stripe = nextStripe++ % WRITER_STRIPES;
+        return stripe;
+    }
+
+    // Returns the slot holding key, claiming an empty one if needed; null if
+    // the table is full
+    Slot *claim(Table &table, const Key &key) {
+        size_t idx = key.hash() & table.mask;
+        for (size_t probes = 0; probes <= table.mask; probes++, idx = (idx + 1) & table.mask) {
+            Slot &slot = table.slots[idx];
+            uint32_t state = slot.state.load(std::memory_order_acquire);
+            if (state == EMPTY) {
+                if (slot.state.compare_exchange_strong(state, CLAIMING, std::memory_order_acq_rel)) {
+                    slot.key = key;
+                    slot.state.store(READY, std::memory_order_release);
+                    count++;
+                    return &slot;
+                }
+            }
+            if (waitReady(slot) == READY && slot.key == key) {
+                return &slot;
+            }
+        }
+        return nullptr;
+    }
+
+    static const Slot *locate(const Table &table, const Key &key) {
+        size_t idx = key.hash() & table.mask;
+        for (size_t probes = 0; probes <= table.mask; probes++, idx = (idx + 1) & table.mask) {
+            const Slot &slot = table.slots[idx];
+            uint32_t state = waitReady(slot);
+            if (state == EMPTY) {
+                return nullptr;
+            }
+            if (slot.key == key) {
+                return &slot;
+            }
+        }
+        return nullptr;
+    }
+
+    // Registers the calling thread as a writer of the current table, waiting
+    // out a resize in progress. Sequentially consistent on both sides, so a
+    // resize either sees this writer or this writer sees the resize.
+    WriterStripe &enterWriter() {
+        WriterStripe &stripe = writers[writerStripe()];
+        while (true) {
+            stripe.active.fetch_add(1);
+            if (!growing.load()) {
+                return stripe;
+            }
+            stripe.active.fetch_sub(1);
+            while (growing.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // Runs fn on key's slot, then grows the table if it is over half full
+    template <typename F>
+    void update(const Key &key, F fn) {
+        while (true) {
+            WriterStripe &stripe = enterWriter();
+            Table &table = *current.load(std::memory_order_acquire);
+            Slot *slot = claim(table, key);
+            size_t seen = table.mask + 1;
+            if (slot != nullptr) {
+                fn(*slot);
+            }
+            bool crowded = slot == nullptr || count.load() * 2 > seen;
+            stripe.active.fetch_sub(1, std::memory_order_release);
+            if (crowded) {
+                grow(seen);
+            }
+            if (slot != nullptr) {
+                return;
+            }
+        }
+    }
+
+    // Doubles the table, unless another writer already grew it past `seen`
+    // slots. With every writer drained, every claimed slot has its value.
+    void grow(size_t seen) {
+        std::lock_guard<std::mutex> guard(growLock);
+        Table &old = *current.load();
+        if (old.mask + 1 != seen) {
+            return;
+        }
+        growing.store(true);
+        for (int w = 0; w < WRITER_STRIPES; w++) {
+            while (writers[w].active.load() != 0) {
+                std::this_thread::yield();
+            }
+        }
+        std::unique_ptr<Table> table(new Table(seen * 2));
+        for (size_t i = 0; i < seen; i++) {
+            if (old.slots[i].state.load(std::memory_order_relaxed) != READY) {
+                continue;
+            }
+            size_t idx = old.slots[i].key.hash() & table->mask;
+            while (table->slots[idx].state.load(std::memory_order_relaxed) != EMPTY) {
+                idx = (idx + 1) & table->mask;
+            }
+            table->slots[idx].key = old.slots[i].key;
+            table->slots[idx].value.store(old.slots[i].value.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            table->slots[idx].state.store(READY, std::memory_order_relaxed);
+        }
+        current.store(table.get(), std::memory_order_release);
+        tables.push_back(std::move(table));
+        growing.store(false, std::memory_order_release);
+    }
+
+public:
+    // Room for `expected` entries before the first resize
+    explicit ConcurrentEntropyStore(size_t expected = 1024) : count(0), writers(new WriterStripe[WRITER_STRIPES]) {
+        size_t size = 16;
+        while (size < expected * 2) {
+            size <<= 1;
+        }
+        tables.emplace_back(new Table(size));
+        current.store(tables.back().get());
+    }
+
+    ConcurrentEntropyStore(const ConcurrentEntropyStore &) = delete;
+    ConcurrentEntropyStore &operator=(const ConcurrentEntropyStore &) = delete;
+
+    // Not safe to call while other threads use either store
+    void swap(ConcurrentEntropyStore &other) {
+        std::swap(tables, other.tables);
+        Table *table = current.load();
+        current.store(other.current.load());
+        other.current.store(table);
+        size_t tmp = count.load();
+        count.store(other.count.load());
+        other.count.store(tmp);
+    }
+
+    void insert(const Key &key, double value) {
+        update(key, [value](Slot &slot) {
+            slot.value.store(toBits(value), std::memory_order_release);
+        });
+    }
+
+    // Atomically adds delta; an absent entry counts as zero
+    void add(const Key &key, double delta) {
+        update(key, [delta](Slot &slot) {
+            uint64_t expected = slot.value.load(std::memory_order_acquire);
+            while (true) {
+                double current = expected == UNSET_VALUE ? 0.0 : fromBits(expected);
+                if (slot.value.compare_exchange_weak(expected, toBits(current + delta), std::memory_order_acq_rel)) {
+                    return;
+                }
+            }
+        });
+    }
+
+    bool find(const Key &key, double &value) const {
+        const Slot *slot = locate(*current.load(std::memory_order_acquire), key);
+        if (slot == nullptr) {
+            return false;
+        }
+        uint64_t bits = slot->value.load(std::memory_order_acquire);
+        if (bits == UNSET_VALUE) {
+            return false;
+        }
+        value = fromBits(bits);
+        return true;
+    }
+
+    bool contains(const Key &key) const {
+        double value;
+        return find(key, value);
+    }
+
+    size_t size() const {
+        return count.load();
+    }
+
+    size_t capacity() const {
+        return current.load()->mask + 1;
+    }
+
+    // Visits every entry with a value; entries added concurrently may be missed
+    template <typename F>
+    void forEach(F fn) const {
+        const Table &table = *current.load(std::memory_order_acquire);
+        for (size_t i = 0; i <= table.mask; i++) {
+            if (table.slots[i].state.load(std::memory_order_acquire) != READY) {
+                continue;
+            }
+            uint64_t bits = table.slots[i].value.load(std::memory_order_acquire);
+            if (bits != UNSET_VALUE) {
+                fn(table.slots[i].key, fromBits(bits));
+            }
+        }
+    }
+
+    // Not safe to call while other threads use the store; frees the tables
+    // replaced by growth
+    void clear() {
+        tables.erase(tables.begin(), tables.end() - 1);
+        Table &table = *tables.back();
+        for (size_t i = 0; i <= table.mask; i++) {
+            table.slots[i].state.store(EMPTY, std::memory_order_relaxed);
+            table.slots[i].value.store(UNSET_VALUE, std::memory_order_relaxed);
+        }
+        count.store(0);
+    }
+};
+
+// Dense table with one entry per subset, indexed by the attribute mask.
+// Values are stored XORed with the unset marker, so a zero page reads as
+// "absent": the table needs no initialisation and only pages holding mined
+// entries ever become resident.
+template <typename Key>
+class DenseEntropyStore {
+private:
+    static constexpr uint64_t UNSET_VALUE = 0x7ff8dead00000000ULL;
+
+    int attributeCount;
+    std::atomic<uint64_t> *values;
+    std::atomic<size_t> count;
+
+    static uint64_t encode(double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits ^ UNSET_VALUE;
+    }
+
+    static double decode(uint64_t stored) {
+        uint64_t bits = stored ^ UNSET_VALUE;
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    size_t bytes() const {
+        return sizeof(uint64_t) << attributeCount;
+    }
+
+public:
+    explicit DenseEntropyStore(int attributeCount) : attributeCount(attributeCount), count(0) {
+        values = static_cast<std::atomic<uint64_t> *>(numaAlloc(bytes(), NumaPolicy::Interleave));
+    }
+
+    DenseEntropyStore(const DenseEntropyStore &) = delete;
+    DenseEntropyStore &operator=(const DenseEntropyStore &) = delete;
+
+    ~DenseEntropyStore() {
+        numaFree(values, bytes());
+    }
+
+    void insert(const Key &key, double value) {
+        if (values[key.word(0)].exchange(encode(value), std::memory_order_acq_rel) == 0) {
+            count++;
+        }
+    }
+
+    void add(const Key &key, double delta) {
+        std::atomic<uint64_t> &slot = values[key.word(0)];
+        uint64_t expected = slot.load(std::memory_order_acquire);
+        while (true) {
+            double current = expected == 0 ? 0.0 : decode(expected);
+            if (slot.compare_exchange_weak(expected, encode(current + delta), std::memory_order_acq_rel)) {
+                if (expected == 0) {
+                    count++;
+                }
+                return;
+            }
+        }
+    }
+
+    bool find(const Key &key, double &value) const {
+        uint64_t stored = values[key.word(0)].load(std::memory_order_acquire);
+        if (stored == 0) {
+            return false;
+        }
+        value = decode(stored);
+        return true;
+    }
+
+    size_t size() const {
+        return count.load();
+    }
+
+    size_t capacity() const {
+        return (size_t)1 << attributeCount;
+    }
+
+    template <typename F>
+    void forEach(F fn) const {
+        for (uint64_t mask = 0; mask < capacity(); mask++) {
+            uint64_t stored = values[mask].load(std::memory_order_acquire);
+            if (stored != 0) {
+                fn(Key::fromLowWord(mask), decode(stored));
+            }
+        }
+    }
+
+    // Not safe to call while other threads use the store
+    void clear() {
+        // Dropping the pages returns them to the zero page, i.e. all unset
+        madvise(values, bytes(), MADV_DONTNEED);
+        count.store(0);
+    }
+};
+
+// Minimal attribute sets with respect to inclusion, answering whether any of
+// them lies inside a given set; holds the relation's keys, and the left-hand
+// sides of functional dependencies. Sets are bucketed by lowest attribute: a
+// set inside Y has its lowest attribute in Y, so a query scans only Y's
+// buckets.
+template <typename Key>
+class MinimalSetIndex {
+private:
+    mutable std::shared_mutex lock;
+    std::vector<std::vector<Key>> byFirst;
+    bool hasEmpty = false;  // The empty set lies inside every set
+    size_t count = 0;
+
+    bool coversLocked(const Key &set) const {
+        if (hasEmpty) {
+            return true;
+        }
+        for (int att : set) {
+            for (const Key &member : byFirst[att]) {
+                if (member.isSubsetOf(set)) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+public:
+    explicit MinimalSetIndex(int attributeCount) : byFirst(attributeCount) {}
+
+    bool covers(const Key &set) const {
+        std::shared_lock<std::shared_mutex> guard(lock);
+        return coversLocked(set);
+    }
+
+    // Adds set unless it contains a member, and forgets members that contain
+    // it; returns whether it was added
+    bool add(const Key &set) {
+        std::unique_lock<std::shared_mutex> guard(lock);
+        if (coversLocked(set)) {
+            return false;
+        }
+        int first = set.empty() ? (int)byFirst.size() - 1 : set.first();
+        for (int a = 0; a <= first; a++) {
+            auto &bucket = byFirst[a];
+            for (size_t k = bucket.size(); k-- > 0;) {
+                if (set.isSubsetOf(bucket[k])) {
+                    bucket[k] = bucket.back();
+                    bucket.pop_back();
+                    count--;
+                }
+            }
+        }
+        if (set.empty()) {
+            hasEmpty = true;
+        } else {
+            byFirst[first].push_back(set);
+        }
+        count++;
+        return true;
+    }
+
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> guard(lock);
+        return count;
+    }
+
+    template <typename F>
+    void forEach(F fn) const {
+        std::shared_lock<std::shared_mutex> guard(lock);
+        if (hasEmpty) {
+            fn(Key());
+        }
+        for (const auto &bucket : byFirst) {
+            for (const Key &member : bucket) {
+                fn(member);
+            }
+        }
+    }
+
+    void clear() {
+        std::unique_lock<std::shared_mutex> guard(lock);
+        for (auto &bucket : byFirst) {
+            bucket.clear();
+        }
+        hasEmpty = false;
+        count = 0;
+    }
+};
+
+// SchemaMiner's entropy store. Up to DENSE_MAX_ATTRIBUTES attributes every
+// subset gets a slot in a flat array; wider relations use the hash table.
+// Either way lookups are O(1) and safe alongside concurrent writers.
+// Any set containing a key is a key too, with the same entropy, log2 of the
+// tuple count, so only minimal keys are recorded: a lookup that misses
+// checks for a recorded key inside the set instead.
+template <typename Key>
+class EntropyStore {
+private:
+    std::unique_ptr<DenseEntropyStore<Key>> dense;
+    std::unique_ptr<ConcurrentEntropyStore<Key>> hashed;
+    std::unique_ptr<MinimalSetIndex<Key>> keys;
+    std::atomic<double> keyEntropy{0};
+
+public:
+    static constexpr int DENSE_MAX_ATTRIBUTES = 28;
+
+    // Initial hash table size for relations too wide for the dense array; it
+    // grows as a run mines more, so the reservation is capped
+    static size_t expectedEntries(int attributeCount) {
+        return attributeCount >= 22 ? (size_t)1 << 22 : (size_t)1 << attributeCount;
+    }
+
+    explicit EntropyStore(int attributeCount) : keys(new MinimalSetIndex<Key>(attributeCount)) {
+        if (attributeCount <= DENSE_MAX_ATTRIBUTES) {
+            dense.reset(new DenseEntropyStore<Key>(attributeCount));
+        } else {
+            hashed.reset(new ConcurrentEntropyStore<Key>(expectedEntries(attributeCount)));
+        }
+    }
+
+    bool isDense() const {
+        return dense != nullptr;
+    }
+
+    void swap(EntropyStore &other) {
+        std::swap(dense, other.dense);
+        std::swap(hashed, other.hashed);
+        std::swap(keys, other.keys);
+        double otherKeyEntropy = other.keyEntropy.load();
+        other.keyEntropy.store(keyEntropy.load());
+        keyEntropy.store(otherKeyEntropy);
+    }
+
+    void insert(const Key &key, double value) {
+        dense ? dense->insert(key, value) : hashed->insert(key, value);
+    }
+
+    void add(const Key &key, double delta) {
+        dense ? dense->add(key, delta) : hashed->add(key, delta);
+    }
+
+    bool find(const Key &key, double &value) const {
+        if (dense ? dense->find(key, value) : hashed->find(key, value)) {
+            return true;
+        }
+        if (!keys->covers(key)) {
+            return false;
+        }
+        value = keyEntropy.load();
+        return true;
+    }
+
+    // Records a key with entropy log2(N). Only the key itself is stored; its
+    // supersets are implied.
+    void addKey(const Key &key, double entropy) {
+        keyEntropy.store(entropy);
+        if (keys->add(key)) {
+            insert(key, entropy);
+        }
+    }
+
+    bool coveredByKey(const Key &set) const {
+        return keys->covers(set);
+    }
+
+    template <typename F>
+    void forEachKey(F fn) const {
+        keys->forEach(fn);
+    }
+
+    bool contains(const Key &key) const {
+        double value;
+        return find(key, value);
+    }
+
+    size_t size() const {
+        return dense ? dense->size() : hashed->size();
+    }
+
+    template <typename F>
+    void forEach(F fn) const {
+        if (dense) {
+            dense->forEach(fn);
+        } else {
+            hashed->forEach(fn);
+        }
+    }
+
+    void clear() {
+        dense ? dense->clear() : hashed->clear();
+        keys->clear();
+    }
+};
+
+#endif // ENTROPY_STORE_HPP
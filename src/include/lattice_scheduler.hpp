@@ -0,0 +1,478 @@
+#ifndef LATTICE_SCHEDULER_HPP
+#define LATTICE_SCHEDULER_HPP
+
+#include "duckdb.hpp"
+#include "numa.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A unit of work for one lattice node. Splittable tasks are run as several
+// disjoint pieces (e.g. hash ranges of a grouping key) whose partial results
+// are combined by finish() once the last piece is done.
+struct LatticeTask {
+    double cost = 0;
+    bool splittable = false;
+    int node = -1;  // NUMA node holding the task's input, if any
+    std::function<void(duckdb::Connection&, int piece, int pieces)> run;
+    std::function<void(duckdb::Connection&)> finish;
+};
+
+// Index of the scheduler worker running on the calling thread, or -1 outside
+// of drain() and runLevel(); lets tasks pick per-worker resources
+inline int &currentWorker() {
+    static thread_local int worker = -1;
+    return worker;
+}
+
+// Drives a query through PendingQuery so the calling worker executes tasks of
+// its own query alongside DuckDB's threads instead of blocking in Query().
+inline duckdb::unique_ptr<duckdb::MaterializedQueryResult> executePending(duckdb::Connection &conn, const std::string &sql) {
+    auto pending = conn.PendingQuery(sql);
+    if (pending->HasError()) {
+        return duckdb::make_uniq<duckdb::MaterializedQueryResult>(pending->GetErrorObject());
+    }
+    duckdb::PendingExecutionResult state;
+    do {
+        state = pending->ExecuteTask();
+        if (state == duckdb::PendingExecutionResult::BLOCKED || state == duckdb::PendingExecutionResult::NO_TASKS_AVAILABLE) {
+            // Sleep until DuckDB reschedules a task rather than spinning a core
+            pending->WaitForTask();
+        }
+    } while (!duckdb::PendingQueryResult::IsResultReady(state) && state != duckdb::PendingExecutionResult::EXECUTION_ERROR);
+    if (state == duckdb::PendingExecutionResult::EXECUTION_ERROR) {
+        return duckdb::make_uniq<duckdb::MaterializedQueryResult>(pending->GetErrorObject());
+    }
+    return duckdb::unique_ptr_cast<duckdb::QueryResult, duckdb::MaterializedQueryResult>(pending->Execute());
+}
+
+// executePending() for statements whose failure is an error. The query's own
+// error is rethrown, so an interrupt by LatticeScheduler::stop() keeps its
+// type and is recognised as one.
+inline duckdb::unique_ptr<duckdb::MaterializedQueryResult> executeChecked(duckdb::Connection &conn, const std::string &sql) {
+    auto result = executePending(conn, sql);
+    if (result->HasError()) {
+        result->ThrowError();
+    }
+    return result;
+}
+
+// Runs one lattice level at a time over a fixed set of worker connections.
+// Tasks are dispatched most expensive first (LPT) and any task costing more
+// than a thread's fair share of the level is split, so the end of a level is
+// not held up by a single straggler.
+//
+// Alternatively tasks can be submit()ted and drain()ed as a pipeline: a
+// finishing task may submit its children straight away, so the next level
+// starts without waiting at a barrier, and results are applied by a separate
+// fold stage so workers go straight back to executing queries.
+//
+// Given a NUMA topology, pipeline workers are pinned round-robin to nodes and
+// prefer tasks whose input lives on their own node, stealing from other nodes
+// only when their own queue and the shared queue are empty.
+//
+// With a stop condition, a watchdog polls it while tasks run. Once it holds,
+// queries in flight are interrupted and no further task runs or finishes:
+// drain() and runLevel() return with whatever had finished before.
+class LatticeScheduler {
+private:
+    int threadCount;
+    double minSplitCost;
+    const NumaTopology *numa;
+    std::vector<std::unique_ptr<duckdb::Connection>> connections;
+
+    struct WorkItem {
+        size_t task;
+        int piece;
+        int pieces;
+        double cost;
+    };
+
+    struct SubmittedTask {
+        LatticeTask task;
+        std::atomic<int> remaining;
+    };
+
+    struct QueuedPiece {
+        std::shared_ptr<SubmittedTask> state;
+        int piece;
+        int pieces;
+        double cost;
+
+        bool operator<(const QueuedPiece &other) const {
+            return cost < other.cost;
+        }
+    };
+
+    // Pipeline stage 1: candidates ready to execute, most expensive on top.
+    // queues[0] holds tasks without a node preference, queues[n + 1] those
+    // preferring node n.
+    std::mutex queueLock;
+    std::condition_variable queueReady;
+    std::vector<std::vector<QueuedPiece>> queues;
+    size_t queuedCount = 0;
+    size_t pendingTasks = 0;
+
+    // Pipeline stage 2: results waiting to be folded into the entropy store
+    std::mutex foldLock;
+    std::condition_variable foldReady;
+    std::deque<std::function<void()>> folds;
+    bool foldsClosed = false;
+
+    std::exception_ptr error;
+    std::mutex errorLock;
+
+    std::function<bool()> stopCondition;
+    std::chrono::milliseconds stopPollInterval{10};
+    std::atomic<bool> stopRequested{false};
+
+    // Polls the stop condition until `done` is set
+    struct Watchdog {
+        std::mutex lock;
+        std::condition_variable wake;
+        bool done = false;
+        std::thread thread;
+
+        Watchdog(LatticeScheduler &scheduler) {
+            if (!scheduler.stopCondition) {
+                return;
+            }
+            thread = std::thread([this, &scheduler] {
+                std::unique_lock<std::mutex> guard(lock);
+                while (!done) {
+                    if (scheduler.stopCondition()) {
+                        guard.unlock();
+                        scheduler.stop();
+                        return;
+                    }
+                    wake.wait_for(guard, scheduler.stopPollInterval);
+                }
+            });
+        }
+
+        ~Watchdog() {
+            if (thread.joinable()) {
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    done = true;
+                }
+                wake.notify_one();
+                thread.join();
+            }
+        }
+    };
+
+    // Whether the exception being handled is DuckDB's for an interrupted query
+    static bool interruptedQuery() {
+        try {
+            throw;
+        } catch (const std::exception &ex) {
+            return duckdb::ErrorData(ex).Type() == duckdb::ExceptionType::INTERRUPT;
+        } catch (...) {
+            return false;
+        }
+    }
+
+    void recordError() {
+        if (stopped() && interruptedQuery()) {
+            return; // Expected: stop() interrupts every connection
+        }
+        std::lock_guard<std::mutex> guard(errorLock);
+        if (!error) {
+            error = std::current_exception();
+        }
+    }
+
+    void rethrowError() {
+        if (error) {
+            std::exception_ptr thrown = error;
+            error = nullptr;
+            std::rethrow_exception(thrown);
+        }
+    }
+
+    int workerNode(int t) const {
+        return numa != nullptr && numa->nodeCount() > 1 ? t % numa->nodeCount() : -1;
+    }
+
+    // Caller holds queueLock
+    void enqueue(QueuedPiece item) {
+        int node = item.state->task.node;
+        auto &queue = queues[node >= 0 && node + 1 < (int)queues.size() ? node + 1 : 0];
+        queue.push_back(std::move(item));
+        std::push_heap(queue.begin(), queue.end());
+        queuedCount++;
+    }
+
+    // Caller holds queueLock and has checked queuedCount > 0. Takes the
+    // costlier top of the worker's own queue and the shared queue, and only
+    // steals from another node when both are empty.
+    QueuedPiece dequeue(int node) {
+        std::vector<QueuedPiece> *best = nullptr;
+        auto consider = [&best](std::vector<QueuedPiece> &queue) {
+            if (!queue.empty() && (best == nullptr || best->front().cost < queue.front().cost)) {
+                best = &queue;
+            }
+        };
+        consider(queues[0]);
+        if (node >= 0) {
+            consider(queues[node + 1]);
+        }
+        if (best == nullptr) {
+            for (auto &queue : queues) {
+                consider(queue);
+            }
+        }
+        std::pop_heap(best->begin(), best->end());
+        QueuedPiece item = std::move(best->back());
+        best->pop_back();
+        queuedCount--;
+        return item;
+    }
+
+    void pipelineWorker(int t) {
+        duckdb::Connection &conn = *connections[t];
+        int node = workerNode(t);
+        if (node >= 0 && numa->bindThread(node)) {
+            currentNumaNode() = node;
+        }
+        currentWorker() = t;
+        while (true) {
+            std::unique_lock<std::mutex> lock(queueLock);
+            queueReady.wait(lock, [this] { return queuedCount > 0 || pendingTasks == 0; });
+            if (queuedCount == 0) {
+                currentWorker() = -1;
+                return;
+            }
+            QueuedPiece item = dequeue(node);
+
+            // Only a short tail is left: spread this task over the idle threads
+            if (item.pieces == 1 && item.state->task.splittable && item.cost > minSplitCost && queuedCount + 1 < (size_t)threadCount) {
+                int pieces = threadCount - (int)queuedCount;
+                item.state->remaining.store(pieces);
+                item.pieces = pieces;
+                item.cost /= pieces;
+                for (int p = 1; p < pieces; p++) {
+                    enqueue({item.state, p, pieces, item.cost});
+                }
+                queueReady.notify_all();
+            }
+            lock.unlock();
+
+            LatticeTask &task = item.state->task;
+            try {
+                if (!stopped()) {
+                    task.run(conn, item.piece, item.pieces);
+                }
+            } catch (...) {
+                recordError();
+            }
+            if (--item.state->remaining == 0) {
+                try {
+                    if (task.finish && !stopped()) {
+                        task.finish(conn);
+                    }
+                } catch (...) {
+                    recordError();
+                }
+                std::lock_guard<std::mutex> guard(queueLock);
+                if (--pendingTasks == 0) {
+                    queueReady.notify_all();
+                }
+            }
+        }
+    }
+
+    void foldWorker() {
+        while (true) {
+            std::unique_lock<std::mutex> lock(foldLock);
+            foldReady.wait(lock, [this] { return !folds.empty() || foldsClosed; });
+            if (folds.empty()) {
+                return;
+            }
+            auto apply = std::move(folds.front());
+            folds.pop_front();
+            lock.unlock();
+            try {
+                apply();
+            } catch (...) {
+                recordError();
+            }
+        }
+    }
+
+public:
+    LatticeScheduler(duckdb::DuckDB &db, int threadCount, double minSplitCost = 1 << 16, const NumaTopology *numa = nullptr)
+        : threadCount(std::max(1, threadCount)), minSplitCost(minSplitCost), numa(numa) {
+        for (int t = 0; t < this->threadCount; t++) {
+            connections.emplace_back(new duckdb::Connection(db));
+        }
+        queues.resize(numa != nullptr ? numa->nodeCount() + 1 : 1);
+    }
+
+    int getThreadCount() const {
+        return threadCount;
+    }
+
+    // Stop once `condition` holds, checked every `interval` while tasks run
+    void setStopCondition(std::function<bool()> condition, std::chrono::milliseconds interval = std::chrono::milliseconds(10)) {
+        stopCondition = std::move(condition);
+        stopPollInterval = interval;
+    }
+
+    // Interrupts running queries and skips every task not yet finished; the
+    // scheduler stays stopped. Safe to call from any thread.
+    void stop() {
+        stopRequested.store(true);
+        for (auto &connection : connections) {
+            connection->Interrupt();
+        }
+        std::lock_guard<std::mutex> guard(queueLock);
+        queueReady.notify_all();
+    }
+
+    bool stopped() const {
+        return stopRequested.load();
+    }
+
+    // Queues a task for drain(); safe to call from a running task
+    void submit(LatticeTask task) {
+        auto state = std::make_shared<SubmittedTask>();
+        double cost = task.cost;
+        state->task = std::move(task);
+        state->remaining.store(1);
+        std::lock_guard<std::mutex> guard(queueLock);
+        pendingTasks++;
+        enqueue({state, 0, 1, cost});
+        queueReady.notify_one();
+    }
+
+    // Hands a result to the fold stage, which applies results one at a time
+    void fold(std::function<void()> apply) {
+        std::lock_guard<std::mutex> guard(foldLock);
+        folds.push_back(std::move(apply));
+        foldReady.notify_one();
+    }
+
+    // Runs submitted tasks, and everything they submit, until none are left
+    // and all of their results have been folded
+    void drain() {
+        Watchdog watchdog(*this);
+        foldsClosed = false;
+        std::thread folder(&LatticeScheduler::foldWorker, this);
+        std::vector<std::thread> threads;
+        for (int t = 1; t < threadCount; t++) {
+            threads.emplace_back(&LatticeScheduler::pipelineWorker, this, t);
+        }
+
+        // The calling thread works as worker 0; undo its pinning afterwards
+        cpu_set_t callerAffinity;
+        bool restoreAffinity = workerNode(0) >= 0 && sched_getaffinity(0, sizeof(callerAffinity), &callerAffinity) == 0;
+        pipelineWorker(0);
+        if (restoreAffinity) {
+            sched_setaffinity(0, sizeof(callerAffinity), &callerAffinity);
+        }
+        currentNumaNode() = -1;
+
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        {
+            std::lock_guard<std::mutex> guard(foldLock);
+            foldsClosed = true;
+            foldReady.notify_one();
+        }
+        folder.join();
+
+        rethrowError();
+    }
+
+    // Returns whether every task ran to the end, i.e. the scheduler was not
+    // stopped before the last one finished
+    bool runLevel(std::vector<LatticeTask> &tasks) {
+        if (tasks.empty()) {
+            return true;
+        }
+        if (!stopped() && stopCondition && stopCondition()) {
+            stop();
+        }
+        if (stopped()) {
+            return false;
+        }
+        Watchdog watchdog(*this);
+
+        double total = 0;
+        for (const auto &task : tasks) {
+            total += task.cost;
+        }
+        double share = total / threadCount;
+
+        std::vector<WorkItem> items;
+        std::unique_ptr<std::atomic<int>[]> remaining(new std::atomic<int>[tasks.size()]);
+        for (size_t i = 0; i < tasks.size(); i++) {
+            int pieces = 1;
+            if (tasks[i].splittable && threadCount > 1 && tasks[i].cost > share && tasks[i].cost > minSplitCost) {
+                pieces = std::min(threadCount, (int)std::ceil(tasks[i].cost / share));
+            }
+            remaining[i].store(pieces);
+            for (int p = 0; p < pieces; p++) {
+                items.push_back({i, p, pieces, tasks[i].cost / pieces});
+            }
+        }
+
+        // Largest first; ties keep submission order so runs are repeatable
+        std::stable_sort(items.begin(), items.end(), [](const WorkItem &a, const WorkItem &b) {
+            return a.cost > b.cost;
+        });
+
+        std::atomic<size_t> next(0);
+        std::atomic<size_t> finished(0);
+
+        auto worker = [&](int t) {
+            duckdb::Connection &conn = *connections[t];
+            currentWorker() = t;
+            size_t idx;
+            while (!stopped() && (idx = next++) < items.size()) {
+                const WorkItem &item = items[idx];
+                LatticeTask &task = tasks[item.task];
+                try {
+                    task.run(conn, item.piece, item.pieces);
+                    if (--remaining[item.task] == 0 && !stopped()) {
+                        if (task.finish) {
+                            task.finish(conn);
+                        }
+                        finished++;
+                    }
+                } catch (...) {
+                    recordError();
+                }
+            }
+            currentWorker() = -1;
+        };
+
+        int workers = (int)std::min<size_t>(threadCount, items.size());
+        std::vector<std::thread> threads;
+        for (int t = 1; t < workers; t++) {
+            threads.emplace_back(worker, t);
+        }
+        worker(0);
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        rethrowError();
+        return finished == tasks.size();
+    }
+};
+
+#endif // LATTICE_SCHEDULER_HPP
@@ -0,0 +1,135 @@
+#ifndef LEVEL_TRAVERSAL_HPP
+#define LEVEL_TRAVERSAL_HPP
+
+#include "attribute_set.hpp"
+
+#include <functional>
+#include <optional>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Apriori-style, level-at-a-time walk of the attribute-set lattice. Level
+// k + 1 candidates join two surviving k-sets that differ only in their last
+// attribute, and are kept only if every other k-subset survived as well.
+// Each level is handed to the engine as one batch; once the next level has
+// been computed, the state of the current one is dropped.
+//
+// Levels are kept in lexicographic order of their attribute lists, so sets
+// sharing a prefix are adjacent and candidates come out in order too.
+template <int Words, typename State>
+class LevelTraversal {
+public:
+    using AttributeSet = AttributeMask<Words>;
+
+    struct Entry {
+        AttributeSet attSet;
+        State state;
+    };
+
+    // attSet is level[parent].attSet plus attribute
+    struct Candidate {
+        AttributeSet attSet;
+        size_t parent;
+        int attribute;
+    };
+
+    // Computes a batch of candidates from the current level, setting
+    // results[c] for each candidate c that survives. Slots are disjoint, so
+    // candidates can be computed concurrently without locking. Returns false
+    // if it was cut short, leaving the results incomplete.
+    using Expander = std::function<bool(const std::vector<Entry> &level, const std::vector<Candidate> &candidates,
+                                        std::vector<std::optional<State>> &results)>;
+
+    // Level 1: every attribute, as a child of the empty set at level[0]
+    static std::vector<Candidate> singletons(int attributeCount) {
+        std::vector<Candidate> candidates;
+        for (int i = 0; i < attributeCount; i++) {
+            candidates.push_back({{i}, 0, i});
+        }
+        return candidates;
+    }
+
+    static std::vector<Candidate> generate(const std::vector<Entry> &level) {
+        std::unordered_set<AttributeSet, AttributeMaskHash<Words>> survivors;
+        for (const auto &entry : level) {
+            survivors.insert(entry.attSet);
+        }
+
+        std::vector<Candidate> candidates;
+        size_t groupStart = 0;
+        while (groupStart < level.size()) {
+            AttributeSet prefix = level[groupStart].attSet;
+            prefix.erase(prefix.last());
+            size_t groupEnd = groupStart + 1;
+            while (groupEnd < level.size()) {
+                AttributeSet other = level[groupEnd].attSet;
+                other.erase(other.last());
+                if (other != prefix) {
+                    break;
+                }
+                groupEnd++;
+            }
+
+            for (size_t a = groupStart; a < groupEnd; a++) {
+                for (size_t b = a + 1; b < groupEnd; b++) {
+                    int attribute = level[b].attSet.last();
+                    AttributeSet candidate = level[a].attSet;
+                    candidate.insert(attribute);
+                    // The subsets without either last attribute are a and b
+                    bool closed = true;
+                    for (int att : prefix) {
+                        AttributeSet subset = candidate;
+                        subset.erase(att);
+                        if (survivors.count(subset) == 0) {
+                            closed = false;
+                            break;
+                        }
+                    }
+                    if (closed) {
+                        candidates.push_back({candidate, a, attribute});
+                    }
+                }
+            }
+            groupStart = groupEnd;
+        }
+        return candidates;
+    }
+
+    // Runs level after level from `level`, which may be just the empty set,
+    // until no candidates are left, a level of at least maxSize attributes
+    // (if not 0) is done, or expand() is cut short. released(k), if given, is called
+    // once the state of level k is gone.
+    //
+    // Returns the size up to which every level was computed: attributeCount
+    // if the lattice ran out of candidates.
+    static int run(int attributeCount, std::vector<Entry> level, const Expander &expand, const std::function<void(int)> &released = nullptr,
+                   int maxSize = 0) {
+        while (!level.empty()) {
+            int size = level.front().attSet.size();
+            if (maxSize > 0 && size >= maxSize) {
+                return size;
+            }
+            std::vector<Candidate> candidates = size == 0 ? singletons(attributeCount) : generate(level);
+            std::vector<Entry> next;
+            if (!candidates.empty()) {
+                std::vector<std::optional<State>> results(candidates.size());
+                if (!expand(level, candidates, results)) {
+                    return size;
+                }
+                for (size_t c = 0; c < candidates.size(); c++) {
+                    if (results[c]) {
+                        next.push_back({candidates[c].attSet, std::move(*results[c])});
+                    }
+                }
+            }
+            level = std::move(next);
+            if (released) {
+                released(size);
+            }
+        }
+        return attributeCount;
+    }
+};
+
+#endif // LEVEL_TRAVERSAL_HPP
@@ -0,0 +1,107 @@
+#ifndef MINING_BUDGET_HPP
+#define MINING_BUDGET_HPP
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+
+// Limits on one computeEntropies() run. Under a budget the lattice is mined
+// one level at a time, smallest sets first, so a run that is cut short still
+// leaves every set of up to some size complete.
+struct MiningBudget {
+    int maxLevel = 0;                        // Largest set size to mine; 0 for all
+    std::chrono::milliseconds timeLimit{0};  // Wall clock from the start of the run; 0 for none
+    size_t memoryLimit = 0;                  // Resident bytes of the process; 0 for none
+
+    bool unlimited() const {
+        return maxLevel == 0 && timeLimit.count() == 0 && memoryLimit == 0;
+    }
+};
+
+enum class MiningStop {
+    None,      // The whole lattice was mined
+    MaxLevel,  // Stopped after budget.maxLevel
+    Deadline,
+    Memory,
+};
+
+inline const char *toString(MiningStop stop) {
+    switch (stop) {
+    case MiningStop::None:
+        return "complete";
+    case MiningStop::MaxLevel:
+        return "level limit";
+    case MiningStop::Deadline:
+        return "deadline";
+    case MiningStop::Memory:
+        return "memory limit";
+    }
+    return "unknown";
+}
+
+// What a run got through. Every set of up to completeLevel attributes has an
+// entropy; of the larger ones, exactly those lookupEntropy() finds do.
+struct MiningReport {
+    MiningStop stop = MiningStop::None;
+    int completeLevel = 0;
+    std::chrono::milliseconds elapsed{0};
+};
+
+// Resident set size of this process, or 0 if it cannot be read
+inline size_t residentBytes() {
+    FILE *statm = std::fopen("/proc/self/statm", "r");
+    if (statm == nullptr) {
+        return 0;
+    }
+    unsigned long size = 0, pages = 0;
+    int read = std::fscanf(statm, "%lu %lu", &size, &pages);
+    std::fclose(statm);
+    return read == 2 ? pages * (size_t)sysconf(_SC_PAGESIZE) : 0;
+}
+
+// Tracks a budget over one run. exhausted() is cheap enough to poll every
+// few milliseconds from any thread; the first limit hit is remembered.
+class BudgetClock {
+private:
+    MiningBudget budget;
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    std::atomic<MiningStop> reason{MiningStop::None};
+
+public:
+    void start(const MiningBudget &budget) {
+        this->budget = budget;
+        started = std::chrono::steady_clock::now();
+        reason.store(MiningStop::None);
+    }
+
+    bool exhausted() {
+        if (reason.load() != MiningStop::None) {
+            return true;
+        }
+        MiningStop hit = MiningStop::None;
+        if (budget.timeLimit.count() > 0 && elapsed() >= budget.timeLimit) {
+            hit = MiningStop::Deadline;
+        } else if (budget.memoryLimit > 0 && residentBytes() >= budget.memoryLimit) {
+            hit = MiningStop::Memory;
+        }
+        if (hit == MiningStop::None) {
+            return false;
+        }
+        MiningStop none = MiningStop::None;
+        reason.compare_exchange_strong(none, hit);
+        return true;
+    }
+
+    MiningStop stopReason() const {
+        return reason.load();
+    }
+
+    std::chrono::milliseconds elapsed() const {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+    }
+};
+
+#endif // MINING_BUDGET_HPP
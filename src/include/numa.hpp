@@ -0,0 +1,207 @@
+#ifndef NUMA_HPP
+#define NUMA_HPP
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// NUMA placement without a libnuma dependency: topology comes from sysfs,
+// memory policy is applied with the raw mbind syscall and threads are pinned
+// with sched_setaffinity. On machines without NUMA every call degrades to a
+// single node and plain anonymous mappings.
+
+enum class NumaPolicy {
+    Local,      // First touch by the allocating thread
+    Bind,       // Pages on the given node
+    Interleave  // Pages spread round-robin over all nodes
+};
+
+class NumaTopology {
+private:
+    std::vector<std::vector<int>> nodeCpus;
+
+    static std::vector<int> parseCpuList(const std::string &list) {
+        std::vector<int> cpus;
+        std::stringstream ss(list);
+        std::string range;
+        while (std::getline(ss, range, ',')) {
+            size_t dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; cpu++) {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+public:
+    NumaTopology() {
+        for (int node = 0;; node++) {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            std::string list;
+            if (!file.is_open() || !std::getline(file, list)) {
+                break;
+            }
+            nodeCpus.push_back(parseCpuList(list));
+        }
+        if (nodeCpus.empty()) {
+            nodeCpus.push_back({});
+        }
+    }
+
+    static const NumaTopology &get() {
+        static NumaTopology topology;
+        return topology;
+    }
+
+    int nodeCount() const {
+        return (int)nodeCpus.size();
+    }
+
+    // Pins the calling thread to the CPUs of node; no-op on single-node hosts
+    bool bindThread(int node) const {
+        if (nodeCount() < 2 || nodeCpus[node].empty()) {
+            return false;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : nodeCpus[node]) {
+            CPU_SET(cpu, &set);
+        }
+        return sched_setaffinity(0, sizeof(set), &set) == 0;
+    }
+};
+
+// Node the calling worker runs on, or -1 when it isn't pinned
+inline int &currentNumaNode() {
+    static thread_local int node = -1;
+    return node;
+}
+
+// Applies a memory policy to an existing mapping before its pages are touched
+inline void numaBind(void *ptr, size_t bytes, NumaPolicy policy, int node = -1) {
+    const NumaTopology &topology = NumaTopology::get();
+    if (topology.nodeCount() > 1 && policy != NumaPolicy::Local) {
+        // Values of MPOL_BIND and MPOL_INTERLEAVE from <linux/mempolicy.h>
+        const int mpolBind = 2;
+        const int mpolInterleave = 3;
+        unsigned long nodeMask = 0;
+        if (policy == NumaPolicy::Interleave) {
+            nodeMask = topology.nodeCount() >= 64 ? ~0UL : (1UL << topology.nodeCount()) - 1;
+        } else if (node >= 0) {
+            nodeMask = 1UL << node;
+        }
+        if (nodeMask != 0) {
+            // Best effort: without the policy the pages are merely first-touch
+            syscall(SYS_mbind, ptr, bytes, policy == NumaPolicy::Interleave ? mpolInterleave : mpolBind,
+                    &nodeMask, sizeof(nodeMask) * 8, 0);
+        }
+    }
+}
+
+inline void *numaAlloc(size_t bytes, NumaPolicy policy, int node = -1) {
+    if (bytes == 0) {
+        return nullptr;
+    }
+    void *ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    numaBind(ptr, bytes, policy, node);
+    return ptr;
+}
+
+inline void numaFree(void *ptr, size_t bytes) {
+    if (ptr != nullptr) {
+        munmap(ptr, bytes);
+    }
+}
+
+// Fixed-capacity array in its own mapping. Pages past `size` are never
+// touched, so reserving a generous capacity costs address space only.
+template <typename T>
+class NumaArray {
+private:
+    T *ptr = nullptr;
+    size_t cap = 0;
+    size_t used = 0;
+    int home = -1;
+    bool owned = true;
+
+    void release() {
+        if (owned) {
+            numaFree(ptr, cap * sizeof(T));
+        }
+    }
+
+public:
+    NumaArray() {}
+
+    NumaArray(size_t capacity, NumaPolicy policy, int node = -1) : cap(capacity), home(node) {
+        ptr = static_cast<T *>(numaAlloc(capacity * sizeof(T), policy, node));
+    }
+
+    // View of memory owned elsewhere, e.g. an arena; never freed by the array
+    static NumaArray borrow(T *data, size_t capacity, int node = -1) {
+        NumaArray array;
+        array.ptr = data;
+        array.cap = capacity;
+        array.home = node;
+        array.owned = false;
+        return array;
+    }
+
+    NumaArray(const NumaArray &) = delete;
+    NumaArray &operator=(const NumaArray &) = delete;
+
+    NumaArray(NumaArray &&other) noexcept {
+        *this = std::move(other);
+    }
+
+    NumaArray &operator=(NumaArray &&other) noexcept {
+        if (this != &other) {
+            release();
+            ptr = other.ptr;
+            cap = other.cap;
+            used = other.used;
+            home = other.home;
+            owned = other.owned;
+            other.ptr = nullptr;
+            other.cap = other.used = 0;
+        }
+        return *this;
+    }
+
+    ~NumaArray() {
+        release();
+    }
+
+    T *data() { return ptr; }
+    const T *data() const { return ptr; }
+    T &operator[](size_t i) { return ptr[i]; }
+    const T &operator[](size_t i) const { return ptr[i]; }
+    size_t size() const { return used; }
+    size_t capacity() const { return cap; }
+    int node() const { return home; }
+
+    void push_back(const T &value) {
+        ptr[used++] = value;
+    }
+
+    void resize(size_t size) {
+        used = size;
+    }
+};
+
+#endif // NUMA_HPP
@@ -0,0 +1,346 @@
+#ifndef PARTITION_HPP
+#define PARTITION_HPP
+
+#include "numa.hpp"
+#include "arena.hpp"
+#include "entropy_kernel.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Row ids of native partitions. 32 bits halve the memory and bandwidth of
+// every partition, so they are the default; build with
+// -DSCHEMA_MINER_64BIT_ROWS for relations of more than 2^32 - 1 rows.
+#ifdef SCHEMA_MINER_64BIT_ROWS
+using RowId = uint64_t;
+#else
+using RowId = uint32_t;
+#endif
+
+const uint64_t MAX_ROW_COUNT = (uint64_t)std::numeric_limits<RowId>::max();
+
+inline void checkRowCount(uint64_t tupleCount) {
+    if (tupleCount > MAX_ROW_COUNT) {
+        throw std::runtime_error("Relation has " + std::to_string(tupleCount) +
+                                 " rows, too many for 32-bit row ids; rebuild with -DSCHEMA_MINER_64BIT_ROWS");
+    }
+}
+
+// Dictionary-encoded copy of the relation, one code array per column.
+// Columns are either interleaved across NUMA nodes or replicated so every
+// node reads a local copy. A relation written with writeTo() can be mapped
+// read-only by other processes, which then share its pages.
+class EncodedRelation {
+private:
+    static constexpr uint64_t FILE_MAGIC = 0x4c4552454e494d53ULL; // "SMINEREL"
+
+    size_t tupleCount = 0;
+    std::vector<uint32_t> cardinalities;
+    // replicas[node][att]; a single interleaved replica when not replicating
+    std::vector<std::vector<NumaArray<uint32_t>>> replicas;
+    // Column pointers into a shared file mapping, if opened from a file
+    std::shared_ptr<void> mapping;
+    std::vector<const uint32_t *> mappedColumns;
+
+public:
+    static EncodedRelation fromCsv(const std::string &csvPath, int attributeCount, bool replicate) {
+        std::ifstream file(csvPath);
+        if (!file.is_open()) {
+            std::cerr << "Could not open the file " << csvPath << std::endl;
+        }
+
+        std::vector<std::vector<uint32_t>> codes(attributeCount);
+        std::vector<std::unordered_map<std::string, uint32_t>> dictionaries(attributeCount);
+        std::string line;
+        while (std::getline(file, line)) {
+            std::stringstream ss(line);
+            std::string value;
+            for (int i = 0; i < attributeCount; i++) {
+                if (!std::getline(ss, value, ',')) {
+                    value.clear();
+                }
+                auto inserted = dictionaries[i].insert({value, (uint32_t)dictionaries[i].size()});
+                codes[i].push_back(inserted.first->second);
+            }
+        }
+
+        EncodedRelation relation;
+        relation.tupleCount = attributeCount == 0 ? 0 : codes[0].size();
+        checkRowCount(relation.tupleCount);
+        for (int i = 0; i < attributeCount; i++) {
+            relation.cardinalities.push_back((uint32_t)dictionaries[i].size());
+        }
+
+        int nodes = replicate ? NumaTopology::get().nodeCount() : 1;
+        relation.replicas.resize(nodes);
+        for (int node = 0; node < nodes; node++) {
+            for (int i = 0; i < attributeCount; i++) {
+                NumaArray<uint32_t> column(relation.tupleCount, replicate ? NumaPolicy::Bind : NumaPolicy::Interleave, node);
+                std::memcpy(column.data(), codes[i].data(), relation.tupleCount * sizeof(uint32_t));
+                column.resize(relation.tupleCount);
+                relation.replicas[node].push_back(std::move(column));
+            }
+        }
+        return relation;
+    }
+
+    // Layout: magic, tuple count, attribute count, cardinalities, then each
+    // column's codes
+    void writeTo(const std::string &path) const {
+        FILE *file = std::fopen(path.c_str(), "wb");
+        if (file == nullptr) {
+            throw std::runtime_error("Could not create relation file " + path);
+        }
+        uint64_t header[3] = {FILE_MAGIC, tupleCount, cardinalities.size()};
+        std::fwrite(header, sizeof(header), 1, file);
+        std::fwrite(cardinalities.data(), sizeof(uint32_t), cardinalities.size(), file);
+        for (size_t i = 0; i < cardinalities.size(); i++) {
+            std::fwrite(column((int)i), sizeof(uint32_t), tupleCount, file);
+        }
+        if (std::fclose(file) != 0) {
+            throw std::runtime_error("Could not write relation file " + path);
+        }
+    }
+
+    static EncodedRelation open(const std::string &path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0) {
+            throw std::runtime_error("Could not open relation file " + path);
+        }
+        size_t bytes = info.st_size;
+        void *ptr = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (ptr == MAP_FAILED) {
+            throw std::runtime_error("Could not map relation file " + path);
+        }
+
+        EncodedRelation relation;
+        relation.mapping = std::shared_ptr<void>(ptr, [bytes](void *p) { munmap(p, bytes); });
+        const uint64_t *header = static_cast<const uint64_t *>(ptr);
+        if (bytes < sizeof(uint64_t) * 3 || header[0] != FILE_MAGIC ||
+            bytes != sizeof(uint64_t) * 3 + header[2] * sizeof(uint32_t) * (1 + header[1])) {
+            throw std::runtime_error("Malformed relation file " + path);
+        }
+        relation.tupleCount = header[1];
+        checkRowCount(relation.tupleCount);
+        const uint32_t *data = reinterpret_cast<const uint32_t *>(header + 3);
+        relation.cardinalities.assign(data, data + header[2]);
+        data += header[2];
+        for (uint64_t i = 0; i < header[2]; i++, data += relation.tupleCount) {
+            relation.mappedColumns.push_back(data);
+        }
+        return relation;
+    }
+
+    size_t tuples() const {
+        return tupleCount;
+    }
+
+    uint32_t cardinality(int att) const {
+        return cardinalities[att];
+    }
+
+    // The calling worker's local replica when columns are replicated
+    const uint32_t *column(int att) const {
+        if (mapping) {
+            return mappedColumns[att];
+        }
+        int node = currentNumaNode();
+        size_t replica = node >= 0 && (size_t)node < replicas.size() ? node : 0;
+        return replicas[replica][att].data();
+    }
+};
+
+// Stripped partition: only classes with more than one row are kept. Rows of
+// class i are rows[offsets[i], offsets[i+1]).
+struct StrippedPartition {
+    NumaArray<RowId> rows;
+    NumaArray<RowId> offsets;
+    double sumCLogC = 0;
+
+    size_t rowCount() const {
+        return rows.size();
+    }
+
+    size_t classCount() const {
+        return offsets.size() == 0 ? 0 : offsets.size() - 1;
+    }
+
+    int node() const {
+        return rows.node();
+    }
+
+    size_t bytes() const {
+        return (rows.size() + offsets.size()) * sizeof(RowId);
+    }
+};
+
+// Output arrays go to the calling worker's node; capacity is an upper bound
+// and unused pages are never touched. From an arena, rows and room for the
+// offsets share one block that packPartition() later shrinks to fit.
+inline StrippedPartition allocatePartition(size_t maxRows, Arena *arena = nullptr) {
+    int node = currentNumaNode();
+    StrippedPartition partition;
+    if (arena != nullptr) {
+        RowId *block = arena->allocateArray<RowId>(maxRows + maxRows / 2 + 1);
+        partition.rows = NumaArray<RowId>::borrow(block, maxRows, node);
+        partition.offsets = NumaArray<RowId>::borrow(block + maxRows, maxRows / 2 + 1, node);
+        return partition;
+    }
+    NumaPolicy policy = node >= 0 ? NumaPolicy::Bind : NumaPolicy::Local;
+    partition.rows = NumaArray<RowId>(maxRows, policy, node);
+    partition.offsets = NumaArray<RowId>(maxRows / 2 + 1, policy, node);
+    return partition;
+}
+
+// Moves an arena partition's offsets down behind its rows and returns the
+// rest of its block to the arena; it must be the arena's latest allocation
+inline void packPartition(StrippedPartition &partition, Arena *arena) {
+    if (arena == nullptr) {
+        return;
+    }
+    RowId *block = partition.rows.data();
+    size_t rows = partition.rows.size();
+    size_t offsets = partition.offsets.size();
+    std::memmove(block + rows, partition.offsets.data(), offsets * sizeof(RowId));
+    int node = partition.node();
+    partition.rows = NumaArray<RowId>::borrow(block, rows, node);
+    partition.rows.resize(rows);
+    partition.offsets = NumaArray<RowId>::borrow(block + rows, offsets, node);
+    partition.offsets.resize(offsets);
+    arena->trim(block, (rows + offsets) * sizeof(RowId));
+}
+
+// Copy of a partition, e.g. to move one built in scratch memory into an arena
+inline StrippedPartition clonePartition(const StrippedPartition &source, Arena *arena = nullptr) {
+    StrippedPartition partition = allocatePartition(source.rowCount(), arena);
+    std::memcpy(partition.rows.data(), source.rows.data(), source.rowCount() * sizeof(RowId));
+    std::memcpy(partition.offsets.data(), source.offsets.data(), source.offsets.size() * sizeof(RowId));
+    partition.rows.resize(source.rowCount());
+    partition.offsets.resize(source.offsets.size());
+    partition.sumCLogC = source.sumCLogC;
+    packPartition(partition, arena);
+    return partition;
+}
+
+// Partition of a single column by counting sort over its codes
+inline StrippedPartition columnPartition(const uint32_t *codes, size_t tupleCount, uint32_t cardinality, Arena *arena = nullptr) {
+    std::vector<RowId> counts(cardinality, 0);
+    for (size_t row = 0; row < tupleCount; row++) {
+        counts[codes[row]]++;
+    }
+
+    StrippedPartition partition = allocatePartition(tupleCount, arena);
+    std::vector<RowId> pos(cardinality, 0);
+    RowId out = 0;
+    for (uint32_t code = 0; code < cardinality; code++) {
+        if (counts[code] > 1) {
+            pos[code] = out;
+            partition.offsets.push_back(out);
+            out += counts[code];
+        }
+    }
+    partition.sumCLogC = sumCLogC(counts.data(), cardinality).value();
+    partition.offsets.push_back(out);
+    if (partition.offsets.size() == 1) {
+        partition.offsets.resize(0);
+    }
+
+    for (size_t row = 0; row < tupleCount; row++) {
+        uint32_t code = codes[row];
+        if (counts[code] > 1) {
+            partition.rows[pos[code]++] = (RowId)row;
+        }
+    }
+    partition.rows.resize(out);
+    packPartition(partition, arena);
+    return partition;
+}
+
+// Per-thread counting arrays for refinement; counts are all zero between uses
+struct RefineScratch {
+    std::vector<RowId> counts;
+    std::vector<RowId> pos;
+    std::vector<uint32_t> touched;
+};
+
+inline RefineScratch &refineScratch(uint32_t cardinality) {
+    static thread_local RefineScratch scratch;
+    if (scratch.counts.size() < cardinality) {
+        scratch.counts.resize(cardinality, 0);
+        scratch.pos.resize(cardinality, 0);
+    }
+    return scratch;
+}
+
+// Splits the class [begin, end) of a parent by the column's codes, appending
+// the non-singleton parts to partition, whose rows are filled up to out.
+// The caller sums c·log2(c) over the finished offsets.
+inline void refineClass(const RowId *begin, const RowId *end, const uint32_t *codes, RefineScratch &scratch,
+                        StrippedPartition &partition, RowId &out) {
+    std::vector<RowId> &counts = scratch.counts;
+    std::vector<RowId> &pos = scratch.pos;
+    std::vector<uint32_t> &touched = scratch.touched;
+
+    touched.clear();
+    for (const RowId *row = begin; row != end; row++) {
+        uint32_t code = codes[*row];
+        if (counts[code]++ == 0) {
+            touched.push_back(code);
+        }
+    }
+
+    for (uint32_t code : touched) {
+        if (counts[code] > 1) {
+            pos[code] = out;
+            partition.offsets.push_back(out);
+            out += counts[code];
+        }
+    }
+
+    for (const RowId *row = begin; row != end; row++) {
+        uint32_t code = codes[*row];
+        if (counts[code] > 1) {
+            partition.rows[pos[code]++] = *row;
+        }
+    }
+
+    for (uint32_t code : touched) {
+        counts[code] = 0;
+    }
+}
+
+// Intersects a partition with a column: every class of the parent is split by
+// the column's codes and singletons are dropped
+inline StrippedPartition refinePartition(const StrippedPartition &parent, const uint32_t *codes, uint32_t cardinality, Arena *arena = nullptr) {
+    RefineScratch &scratch = refineScratch(cardinality);
+    StrippedPartition partition = allocatePartition(parent.rowCount(), arena);
+    RowId out = 0;
+    for (size_t c = 0; c < parent.classCount(); c++) {
+        refineClass(parent.rows.data() + parent.offsets[c], parent.rows.data() + parent.offsets[c + 1], codes, scratch, partition, out);
+    }
+    if (out > 0) {
+        partition.offsets.push_back(out);
+    }
+    partition.sumCLogC = sumClassCLogC(partition.offsets.data(), partition.classCount()).value();
+    partition.rows.resize(out);
+    packPartition(partition, arena);
+    return partition;
+}
+
+#endif // PARTITION_HPP
@@ -0,0 +1,406 @@
+#ifndef PARTITION_CACHE_HPP
+#define PARTITION_CACHE_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Byte-budgeted cache of lattice partitions (TID tables, stripped partitions).
+//
+// A partition is only needed while children of its node are still to be
+// computed, so every entry counts its pending children and is dropped as soon
+// as the last one is done. Above the budget, unpinned entries are evicted by
+// GreedyDual-Size priority: an entry's priority is the cache clock plus its
+// recompute cost times its pending children per byte; a hit refreshes it, and
+// evicting an entry advances the clock to its priority, so entries not used
+// for a while age out even if they were expensive.
+//
+// Evicted partitions keep their bookkeeping and are rebuilt on the next
+// acquire by the caller's materializer, which typically acquires the parent
+// set in turn, so rebuilding walks up to the nearest cached ancestor.
+//
+// With a disk tier, evicted partitions are spilled to local storage instead
+// while the disk budget allows, making room there by discarding spilled
+// partitions of lower priority, and are loaded back on the next acquire.
+// Engines only supply the spill/load hooks; acquire() looks the same.
+//
+// Hooks receive a caller-supplied Context (e.g. a database connection) so
+// rebuilding and dropping run on the thread that triggered them.
+template <typename Key, typename Value, typename Context, typename Hash = std::hash<Key>>
+class PartitionCache {
+public:
+    // Builds the partition for a key and reports its size
+    using Materializer = std::function<Value(Context &, const Key &, size_t &bytes)>;
+    using Dropper = std::function<void(Context &, const Key &, Value &)>;
+    // Writes a partition out and frees it in memory; returns its size on
+    // disk, or 0 if it could not be written and was only freed
+    using Spiller = std::function<size_t(Context &, const Key &, Value &)>;
+    // Reads a spilled partition back in, removing its disk copy
+    using Loader = std::function<Value(Context &, const Key &, size_t &bytes)>;
+    // Removes the disk copy of a spilled partition
+    using Discarder = std::function<void(Context &, const Key &)>;
+
+private:
+    // Moving: being dropped, spilled or discarded by dropVictims()
+    enum class State { Resident, Building, Moving, Spilled, Evicted };
+
+    struct Entry {
+        Value value{};
+        State state = State::Evicted;
+        size_t bytes = 0;
+        size_t diskBytes = 0;
+        double cost = 0;
+        int pendingChildren = 0;
+        int pins = 0;
+        double priority = 0;
+        bool eraseAfterDrop = false;
+    };
+
+    std::mutex lock;
+    std::condition_variable settled;
+    std::unordered_map<Key, Entry, Hash> entries;
+    // Resident, unpinned entries by priority
+    std::set<std::pair<double, Key>> evictable;
+    // Spilled entries by priority
+    std::set<std::pair<double, Key>> spilled;
+
+    size_t budget;
+    size_t used = 0;
+    double clock = 0;
+    size_t evictions = 0;
+    size_t rebuilds = 0;
+    Dropper drop;
+
+    size_t diskBudget = 0;
+    size_t diskUsed = 0;
+    size_t spills = 0;
+    size_t loads = 0;
+    Spiller spill;
+    Loader load;
+    Discarder discard;
+
+    enum class Action { Drop, Spill, Discard };
+
+    struct Victim {
+        Key key;
+        Value value;
+        Action action;
+    };
+
+    double priorityOf(const Entry &entry) const {
+        return clock + entry.cost * std::max(1, entry.pendingChildren) / std::max<size_t>(1, entry.bytes);
+    }
+
+    // Caller holds lock; the entry must be resident and unpinned
+    void makeEvictable(const Key &key, Entry &entry) {
+        entry.priority = priorityOf(entry);
+        evictable.insert({entry.priority, key});
+    }
+
+    // Caller holds lock. Makes room for `bytes` on disk by discarding spilled
+    // entries of lower priority; false, discarding nothing, if those would
+    // not free enough. Their space is given back here rather than by
+    // dropVictims(), so the new spill can use it at once.
+    bool reserveDisk(size_t bytes, double priority, std::vector<Victim> &victims) {
+        if (!spill || bytes > diskBudget) {
+            return false;
+        }
+        size_t freed = 0;
+        auto last = spilled.begin();
+        for (; diskUsed - freed + bytes > diskBudget; ++last) {
+            if (last == spilled.end() || last->first >= priority) {
+                return false;
+            }
+            freed += entries[last->second].diskBytes;
+        }
+        std::vector<Key> discarded;
+        for (auto it = spilled.begin(); it != last; ++it) {
+            discarded.push_back(it->second);
+        }
+        for (const Key &key : discarded) {
+            Entry &entry = entries[key];
+            retire(key, entry, false, victims);
+            entry.diskBytes = 0;
+        }
+        diskUsed -= freed;
+        return true;
+    }
+
+    // Caller holds lock. Takes an entry out of memory (or off disk); the work
+    // is done by dropVictims() once the lock is released. Erased entries are
+    // forgotten; others are spilled if the disk tier has room.
+    void retire(const Key &key, Entry &entry, bool erase, std::vector<Victim> &victims) {
+        if (entry.state == State::Resident) {
+            if (entry.pins == 0) {
+                evictable.erase({entry.priority, key});
+            }
+            used -= entry.bytes;
+            entry.state = State::Moving;
+            entry.eraseAfterDrop = erase;
+            Action action = Action::Drop;
+            if (!erase && reserveDisk(entry.bytes, entry.priority, victims)) {
+                // Reserve the in-memory size until the real one is known
+                diskUsed += entry.bytes;
+                entry.diskBytes = entry.bytes;
+                action = Action::Spill;
+            }
+            victims.push_back({key, std::move(entry.value), action});
+            entry.value = Value{};
+        } else if (entry.state == State::Spilled) {
+            spilled.erase({entry.priority, key});
+            entry.state = State::Moving;
+            entry.eraseAfterDrop = erase;
+            victims.push_back({key, Value{}, Action::Discard});
+        } else if (erase && entry.state == State::Evicted) {
+            entries.erase(key);
+        } else if (erase) {
+            entry.eraseAfterDrop = true;
+        }
+    }
+
+    // Caller holds lock
+    void evictOverBudget(std::vector<Victim> &victims) {
+        while (used > budget && !evictable.empty()) {
+            auto victim = *evictable.begin();
+            Entry &entry = entries[victim.second];
+            clock = victim.first;
+            evictions++;
+            retire(victim.second, entry, false, victims);
+        }
+    }
+
+    void dropVictims(Context &context, std::vector<Victim> &victims) {
+        std::vector<size_t> written(victims.size(), 0);
+        for (size_t v = 0; v < victims.size(); v++) {
+            Victim &victim = victims[v];
+            if (victim.action == Action::Drop) {
+                drop(context, victim.key, victim.value);
+            } else if (victim.action == Action::Spill) {
+                written[v] = spill(context, victim.key, victim.value);
+            } else {
+                discard(context, victim.key);
+            }
+        }
+        std::vector<Victim> followUps;
+        std::unique_lock<std::mutex> guard(lock);
+        for (size_t v = 0; v < victims.size(); v++) {
+            auto it = entries.find(victims[v].key);
+            if (it == entries.end() || it->second.state != State::Moving) {
+                continue;
+            }
+            Entry &entry = it->second;
+            if (victims[v].action != Action::Drop) {
+                diskUsed -= entry.diskBytes;
+                entry.diskBytes = 0;
+            }
+            if (victims[v].action == Action::Spill && written[v] > 0 && !entry.eraseAfterDrop) {
+                diskUsed += written[v];
+                entry.diskBytes = written[v];
+                entry.state = State::Spilled;
+                spilled.insert({entry.priority, it->first});
+                spills++;
+            } else if (victims[v].action == Action::Spill && written[v] > 0) {
+                // No longer needed by the time it was written out
+                entry.state = State::Spilled;
+                entry.diskBytes = written[v];
+                diskUsed += written[v];
+                retire(it->first, entry, true, followUps);
+            } else if (entry.eraseAfterDrop) {
+                entries.erase(it);
+            } else {
+                entry.state = State::Evicted;
+            }
+        }
+        settled.notify_all();
+        guard.unlock();
+        if (!followUps.empty()) {
+            dropVictims(context, followUps);
+        }
+    }
+
+public:
+    PartitionCache(size_t budget, Dropper drop) : budget(budget), drop(std::move(drop)) {}
+
+    // Spill evicted partitions to disk, keeping at most diskBudget bytes there
+    void setDiskTier(size_t diskBudget, Spiller spill, Loader load, Discarder discard) {
+        this->diskBudget = diskBudget;
+        this->spill = std::move(spill);
+        this->load = std::move(load);
+        this->discard = std::move(discard);
+    }
+
+    PartitionCache(const PartitionCache &) = delete;
+    PartitionCache &operator=(const PartitionCache &) = delete;
+
+    // Adds a freshly computed partition whose node has `pendingChildren`
+    // children to compute, and which costs `cost` to rebuild from its parent
+    void insert(Context &context, const Key &key, Value value, size_t bytes, double cost, int pendingChildren) {
+        std::vector<Victim> victims;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (pendingChildren == 0) {
+                victims.push_back({key, std::move(value), Action::Drop});
+            } else {
+                Entry &entry = entries[key];
+                entry.value = std::move(value);
+                entry.state = State::Resident;
+                entry.bytes = bytes;
+                entry.cost = cost;
+                entry.pendingChildren = pendingChildren;
+                used += bytes;
+                makeEvictable(key, entry);
+                evictOverBudget(victims);
+            }
+        }
+        if (pendingChildren == 0) {
+            drop(context, victims[0].key, victims[0].value);
+            return;
+        }
+        dropVictims(context, victims);
+    }
+
+    // Pins and returns a partition, rebuilding it with `materialize` if it
+    // was evicted or never cached. Every acquire needs a release().
+    Value acquire(Context &context, const Key &key, const Materializer &materialize) {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            Entry &entry = entries[key];
+            if (entry.state == State::Resident) {
+                if (entry.pins++ == 0) {
+                    evictable.erase({entry.priority, key});
+                }
+                return entry.value;
+            }
+            if (entry.state == State::Evicted || entry.state == State::Spilled) {
+                break;
+            }
+            settled.wait(guard);
+        }
+        Entry &pending = entries[key];
+        bool fromDisk = pending.state == State::Spilled;
+        if (fromDisk) {
+            spilled.erase({pending.priority, key});
+        }
+        pending.state = State::Building;
+        guard.unlock();
+
+        size_t bytes = 0;
+        Value value;
+        try {
+            value = fromDisk ? load(context, key, bytes) : materialize(context, key, bytes);
+        } catch (...) {
+            guard.lock();
+            Entry &failed = entries[key];
+            diskUsed -= failed.diskBytes;
+            failed.diskBytes = 0;
+            failed.state = State::Evicted;
+            settled.notify_all();
+            throw;
+        }
+
+        std::vector<Victim> victims;
+        guard.lock();
+        Entry &entry = entries[key];
+        entry.value = value;
+        entry.state = State::Resident;
+        entry.bytes = bytes;
+        entry.pins = 1;
+        used += bytes;
+        diskUsed -= entry.diskBytes;
+        entry.diskBytes = 0;
+        fromDisk ? loads++ : rebuilds++;
+        evictOverBudget(victims);
+        settled.notify_all();
+        guard.unlock();
+        dropVictims(context, victims);
+        return value;
+    }
+
+    void release(Context &context, const Key &key) {
+        std::vector<Victim> victims;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            auto it = entries.find(key);
+            if (it == entries.end() || --it->second.pins > 0) {
+                return;
+            }
+            if (it->second.pendingChildren <= 0) {
+                retire(key, it->second, true, victims);
+            } else {
+                makeEvictable(key, it->second);
+                evictOverBudget(victims);
+            }
+        }
+        dropVictims(context, victims);
+    }
+
+    // One child of key's node has been computed; the partition goes once no
+    // child needs it. Keys that were never inserted are ignored.
+    void childDone(Context &context, const Key &key) {
+        std::vector<Victim> victims;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            auto it = entries.find(key);
+            if (it == entries.end() || --it->second.pendingChildren > 0 || it->second.pins > 0) {
+                return;
+            }
+            retire(key, it->second, true, victims);
+        }
+        dropVictims(context, victims);
+    }
+
+    // Drops every cached partition, in memory or on disk; no partition may
+    // be pinned
+    void clear(Context &context) {
+        std::vector<Victim> victims;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            std::vector<Key> keys;
+            for (const auto &entry : entries) {
+                keys.push_back(entry.first);
+            }
+            for (const auto &key : keys) {
+                retire(key, entries[key], true, victims);
+            }
+        }
+        dropVictims(context, victims);
+    }
+
+    size_t bytesUsed() {
+        std::lock_guard<std::mutex> guard(lock);
+        return used;
+    }
+
+    size_t evictionCount() {
+        std::lock_guard<std::mutex> guard(lock);
+        return evictions;
+    }
+
+    size_t rebuildCount() {
+        std::lock_guard<std::mutex> guard(lock);
+        return rebuilds;
+    }
+
+    size_t diskBytesUsed() {
+        std::lock_guard<std::mutex> guard(lock);
+        return diskUsed;
+    }
+
+    size_t spillCount() {
+        std::lock_guard<std::mutex> guard(lock);
+        return spills;
+    }
+
+    size_t loadCount() {
+        std::lock_guard<std::mutex> guard(lock);
+        return loads;
+    }
+};
+
+#endif // PARTITION_CACHE_HPP
@@ -2,33 +2,48 @@
 #define SCHEMA_MINER_HPP
 
 #include "duckdb.hpp"
+#include "lattice_scheduler.hpp"
+#include "entropy_store.hpp"
+#include "entropy_file.hpp"
+#include "entropy_kernel.hpp"
+#include "mining_budget.hpp"
+#include "entropy_bounds.hpp"
+#include "checkpoint.hpp"
+#include "attribute_set.hpp"
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <string>
 #include <queue>
 #include <map>
-#include <set>
 #include <vector>
 #include <chrono>
 #include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <thread>
+#include <stdexcept>
 
-using AttributeSet = std::set<int>;
-
-std::string toString(const AttributeSet &attrSet) {
-    std::string str = "AttrSet{";
-    for (const int &val : attrSet) {
-        str += std::to_string(val) + ", ";
-    }
-    if (!attrSet.empty()) {
-        str.pop_back(); // Remove trailing space and comma
-        str.pop_back();
-    }
-    str += "}";
-    return str;
-}
+// A lattice node that survived, with the shape of its stripped partition:
+// rows in non-singleton classes and the number of such classes. Its entropy
+// is kept for children that inherit it through a functional dependency.
+template <typename AttributeSet>
+struct LatticeNode {
+    AttributeSet attSet;
+    long long rows;
+    long long classes;
+    double entropy = 0;
+};
 
+// Engines are instantiated per lattice width; Words 64-bit words hold up to
+// 64 * Words attributes
+template <int Words>
 class SchemaMiner {
+public:
+    using AttributeSet = AttributeMask<Words>;
+    using Node = LatticeNode<AttributeSet>;
+
 protected:
     // Database 
     duckdb::DuckDB db;
@@ -37,74 +52,423 @@ protected:
     // Relation info
     std::string csvPath;
     int attributeCount;
-    int tupleCount;
+    int64_t tupleCount = 0;
     std::hash<std::string> strHasher;
     std::hash<int> intHasher;
 
-    std::map<AttributeSet, double> entropies;
+    EntropyStore<AttributeSet> entropies;
+
+    // Distinct values per column, used by the lattice cost model
+    std::vector<long long> columnCardinalities;
+    int threadCount;
 
-    std::map<int, int> attributeRenames;
+    // Engines work on logical attribute positions; logical attribute i is
+    // physical column attributeOrder[i]. Results are stored under physical
+    // attributes, translated as they are stored.
+    std::vector<int> attributeOrder;
+    AttributePermutation<Words> toPhysical;
+    AttributePermutation<Words> toLogical;
+
+    // Left-hand sides of the functional dependencies X → a found so far, per
+    // attribute a. X ∪ {a} then has X's partition, and so does Y ∪ {a} for
+    // any Y ⊇ X: engines reuse the parent's result instead of computing it.
+    std::vector<std::unique_ptr<MinimalSetIndex<AttributeSet>>> determinants;
+
+    MiningBudget budget;
+    BudgetClock budgetClock;
+    MiningReport report;
 
     double getLogN() {
-        return log2(tupleCount);
+        return log2((double)tupleCount);
     }
 
     std::string getTblName(const AttributeSet &attrSet) {
-        std::string name = "TBL_";
+        std::string name = "TBL";
         for (const auto &val : attrSet) {
-            name += std::to_string(val);
+            name += "_" + std::to_string(val);
         }
         return name;
     }
 
+    // SQL for a group's c·log2(c) in CLogCSum units. SUM() over it adds
+    // HUGEINTs, which is exact, so the total does not depend on how DuckDB
+    // or the scheduler splits the groups.
+    static std::string fixedCLogC(const std::string &count) {
+        return "CAST(ROUND(" + count + " * LOG2(" + count + ") * 4294967296.0) AS HUGEINT)";
+    }
+
+    // Throws on NULL, like every GetValue
+    static CLogCSum readCLogCSum(const duckdb::Value &value) {
+        auto units = value.GetValue<duckdb::hugeint_t>();
+        CLogCSum sum;
+        sum.units = (__int128)((unsigned __int128)(uint64_t)units.upper << 64 | units.lower);
+        return sum;
+    }
+
+    std::string getColumnName(int att) {
+        return "col" + std::to_string(attributeOrder[att]);
+    }
+
+    void loadColumnCardinalities() {
+        columnCardinalities.clear();
+        for (int i = 0; i < attributeCount; i++) {
+            columnCardinalities.push_back(conn.Query("SELECT COUNT(DISTINCT col" + std::to_string(i) + ") FROM data;")->GetValue(0, 0).GetValue<int64_t>());
+        }
+    }
+
+    void setEntropy(const AttributeSet &attSet, double entropy) {
+        entropies.insert(toPhysical.apply(attSet), entropy);
+    }
+
+    // attSet has no two equal rows, so H = log2(N) for it and every superset;
+    // engines stop expanding there
+    void setKey(const AttributeSet &attSet) {
+        entropies.addKey(toPhysical.apply(attSet), getLogN());
+    }
+
+    bool coveredByKey(const AttributeSet &attSet) const {
+        return entropies.coveredByKey(toPhysical.apply(attSet));
+    }
+
+    // X ∪ {a} turned out to have the same partition as X
+    void addDependency(const AttributeSet &lhs, int rhs) {
+        determinants[rhs]->add(lhs);
+    }
+
+    // Whether some recorded X → a has X ⊆ attSet
+    bool isDetermined(const AttributeSet &attSet, int rhs) const {
+        return determinants[rhs]->covers(attSet);
+    }
+
+    // The stored entropy of attSet, in logical attributes, if any
+    bool knownEntropy(const AttributeSet &attSet, double &entropy) const {
+        return entropies.find(toPhysical.apply(attSet), entropy);
+    }
+
+    // Whether attSet, in logical attributes, has an entropy in the store
+    bool isKnown(const AttributeSet &attSet) const {
+        double entropy;
+        return knownEntropy(attSet, entropy);
+    }
+
+    // Computes and stores the entropies of attSets, in logical attributes,
+    // for entropy(). Engines that can compute a single set without mining
+    // the lattice around it override this.
+    virtual void computeOnDemand(const std::vector<AttributeSet> &) {
+        throw std::runtime_error("This engine cannot compute entropies on demand; call computeEntropies()");
+    }
+
+    // Computes and stores the entropies of a known workload, in logical
+    // attributes, for computeTargets(). Engines that can share work between
+    // targets override this; by default each is computed on its own by
+    // computeOnDemand().
+    virtual void computeTargetSets(const std::vector<AttributeSet> &targets) {
+        computeOnDemand(targets);
+    }
+
+    // computeTargetSets() for engines that can only mine the lattice: every
+    // level up to the largest target, under the budget's other limits
+    void computeTargetLevels(const std::vector<AttributeSet> &targets) {
+        MiningBudget saved = budget;
+        budget.maxLevel = 1;
+        for (const auto &target : targets) {
+            budget.maxLevel = std::max(budget.maxLevel, (int)target.size());
+        }
+        try {
+            computeEntropies();
+        } catch (...) {
+            budget = saved;
+            throw;
+        }
+        budget = saved;
+    }
+
+    // The sets of a request, given in physical attributes, that have no
+    // entropy yet: in logical attributes, without duplicates, smallest first
+    std::vector<AttributeSet> missingSets(const std::vector<AttributeSet> &attSets) const {
+        std::vector<AttributeSet> missing;
+        for (const auto &attSet : attSets) {
+            if (!attSet.empty() && attSet.last() >= attributeCount) {
+                throw std::invalid_argument("No attribute " + std::to_string(attSet.last()) + " in " + toString(attSet));
+            }
+            double entropy;
+            if (!entropies.find(attSet, entropy)) {
+                missing.push_back(toLogical.apply(attSet));
+            }
+        }
+        std::sort(missing.begin(), missing.end(), [](const AttributeSet &a, const AttributeSet &b) {
+            return a.size() != b.size() ? a.size() < b.size() : a < b;
+        });
+        missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+        return missing;
+    }
+
+    // Everything mined so far, in physical attributes
+    void fillCheckpoint(Checkpoint<AttributeSet> &checkpoint) const {
+        checkpoint.attributeCount = attributeCount;
+        checkpoint.tupleCount = tupleCount;
+        checkpoint.entropies.clear();
+        entropies.forEach([&](const AttributeSet &attSet, double entropy) {
+            checkpoint.entropies.push_back({attSet, entropy});
+        });
+        checkpoint.keys = getMinimalKeys();
+        checkpoint.dependencies.clear();
+        for (const auto &dependency : getFunctionalDependencies()) {
+            checkpoint.dependencies.push_back({dependency.first, (uint64_t)dependency.second});
+        }
+    }
+
+    // Takes back what fillCheckpoint() saved, after checking it was taken of
+    // the same data
+    void restoreCheckpoint(const Checkpoint<AttributeSet> &checkpoint, uint64_t fingerprint) {
+        if (checkpoint.fingerprint != fingerprint || checkpoint.attributeCount != (uint64_t)attributeCount ||
+            checkpoint.tupleCount != (uint64_t)tupleCount) {
+            throw std::runtime_error("The checkpoint was taken of different data than " + csvPath);
+        }
+        for (const auto &entry : checkpoint.entropies) {
+            entropies.insert(entry.attSet, entry.entropy);
+        }
+        for (const auto &key : checkpoint.keys) {
+            entropies.addKey(key, getLogN());
+        }
+        for (const auto &dependency : checkpoint.dependencies) {
+            addDependency(toLogical.apply(dependency.lhs), toLogical.apply(AttributeSet{(int)dependency.rhs}).first());
+        }
+    }
+
+    bool budgeted() const {
+        return !budget.unlimited();
+    }
+
+    // Set sizes the budget allows
+    int budgetLevels() const {
+        return budget.maxLevel > 0 ? std::min(budget.maxLevel, attributeCount) : attributeCount;
+    }
+
+    // Engines start the clock when a run starts and hand it to their
+    // scheduler, which interrupts its queries once the budget is spent
+    void startBudget() {
+        budgetClock.start(budget);
+        report = MiningReport();
+    }
+
+    void watchBudget(LatticeScheduler &scheduler) {
+        if (budget.timeLimit.count() > 0 || budget.memoryLimit > 0) {
+            scheduler.setStopCondition([this] {
+                return budgetClock.exhausted();
+            });
+        }
+    }
+
+    bool budgetExhausted() {
+        return budgetClock.exhausted();
+    }
+
+    // Every set of up to completeLevel attributes has been mined
+    void finishBudget(int completeLevel) {
+        report.completeLevel = std::min(completeLevel, attributeCount);
+        report.elapsed = budgetClock.elapsed();
+        if (report.completeLevel == attributeCount) {
+            report.stop = MiningStop::None;
+        } else if (budgetClock.stopReason() != MiningStop::None) {
+            report.stop = budgetClock.stopReason();
+        } else {
+            report.stop = MiningStop::MaxLevel;
+        }
+    }
+
+    // Orders attributes by decreasing number of distinct values. Only the
+    // logical order changes: the table keeps its columns and names.
     void reorderColumns() {
-        std::vector<std::pair<int, int>> colCounts = {};
+        loadColumnCardinalities();
+        std::vector<std::pair<int, long long>> colCounts = {};
         for (int i = 0; i < attributeCount; i++) {
-            colCounts.push_back({i, conn.Query("SELECT COUNT(DISTINCT col" + std::to_string(i) + ") FROM data;")->GetValue(0, 0).GetValue<int>()});
+            colCounts.push_back({i, columnCardinalities[i]});
         }
     
-        std::sort(colCounts.begin(), colCounts.end(), [](const std::pair<int, int>& a, const std::pair<int, int>& b) {
+        std::stable_sort(colCounts.begin(), colCounts.end(), [](const std::pair<int, long long>& a, const std::pair<int, long long>& b) {
             return a.second > b.second; // Compare the second elem (distinct count)
         });
 
-        // Temporarily rename columns 
         for (int i = 0; i < attributeCount; i++) {
-            conn.Query("ALTER TABLE data RENAME COLUMN col" + std::to_string(i) + " TO temp_col" + std::to_string(i) + ";");
+            attributeOrder[i] = colCounts[i].first;
+            columnCardinalities[i] = colCounts[i].second;
+        }
+        toPhysical = AttributePermutation<Words>(attributeOrder);
+        std::vector<int> inverse(attributeCount);
+        for (int i = 0; i < attributeCount; i++) {
+            inverse[attributeOrder[i]] = i;
         }
+        toLogical = AttributePermutation<Words>(inverse);
+    }
 
-        // Reorder
+public:
+    SchemaMiner(std::string csvPath, int attributeCount) : db(nullptr), conn(db), entropies(attributeCount) {
+        if (attributeCount > AttributeSet::CAPACITY) {
+            throw std::invalid_argument("Too many attributes for this lattice width");
+        }
+        this->csvPath = csvPath;
+        this->attributeCount = attributeCount;
         for (int i = 0; i < attributeCount; i++) {
-            conn.Query("ALTER TABLE data RENAME COLUMN temp_col" + std::to_string(colCounts[i].first) + " TO col" + std::to_string(i) + ";"); 
-            attributeRenames[i] = colCounts[i].first;
+            attributeOrder.push_back(i);
+            determinants.emplace_back(new MinimalSetIndex<AttributeSet>(attributeCount));
         }
+        this->threadCount = std::max(1u, std::thread::hardware_concurrency());
     }
 
-    void renameEntropies() { 
-        std::map<AttributeSet, double> newEntropies;
-        for (const auto& [attSet, entropy] : entropies) {
-            AttributeSet newAttSet;
-            for (const auto& att : attSet) {
-                newAttSet.insert(attributeRenames[att]);
-            }
-            newEntropies[newAttSet] = entropy;
+    void setThreadCount(int threadCount) {
+        this->threadCount = std::max(1, threadCount);
+    }
+
+    // Limits later computeEntropies() runs; see MiningBudget
+    void setBudget(const MiningBudget &budget) {
+        if (budget.maxLevel < 0) {
+            throw std::invalid_argument("The level limit cannot be negative");
         }
-        entropies = newEntropies;
+        this->budget = budget;
     }
 
-public:
-    SchemaMiner(std::string csvPath, int attributeCount) : db(nullptr), conn(db) {
-        this->csvPath = csvPath;
-        this->attributeCount = attributeCount;
+    // How far the last computeEntropies() run got
+    const MiningReport &getReport() const {
+        return report;
     }
 
     void clearEntropies() {
         entropies.clear();
+        for (auto &lhs : determinants) {
+            lhs->clear();
+        }
     }
 
+    virtual ~SchemaMiner() {}
+
     virtual void computeEntropies() = 0;
 
+    // Safe to call from another thread while computeEntropies() is running.
+    // Supersets of keys are answered without being stored.
+    bool lookupEntropy(const AttributeSet &attSet, double &entropy) const {
+        return entropies.find(attSet, entropy);
+    }
+
+    // H(attSet), in physical attributes. Entropies already mined or computed
+    // are returned as they are; others are computed on demand, which does
+    // not need computeEntropies() to have run, and kept for later calls.
+    // Not safe to call concurrently with itself or computeEntropies().
+    double entropy(const AttributeSet &attSet) {
+        return entropy(std::vector<AttributeSet>{attSet})[0];
+    }
+
+    // entropy() for several sets at once: the missing ones are computed
+    // together, smaller sets first, so they can seed the larger ones
+    std::vector<double> entropy(const std::vector<AttributeSet> &attSets) {
+        std::vector<AttributeSet> missing = missingSets(attSets);
+        if (!missing.empty()) {
+            computeOnDemand(missing);
+        }
+
+        std::vector<double> result(attSets.size());
+        for (size_t i = 0; i < attSets.size(); i++) {
+            if (!entropies.find(attSets[i], result[i])) {
+                throw std::runtime_error("Could not compute the entropy of " + toString(attSets[i]));
+            }
+        }
+        return result;
+    }
+
+    // Interval for H(attSet), in physical attributes, from the entropies
+    // stored so far; exact if attSet's own is stored. Computes nothing.
+    EntropyInterval entropyBounds(const AttributeSet &attSet, int depth = 2) const {
+        double maxEntropy = tupleCount > 0 ? log2((double)tupleCount) : std::numeric_limits<double>::infinity();
+        EntropyBounds<Words> bounds([this](const AttributeSet &set, double &entropy) {
+            return entropies.find(set, entropy);
+        }, maxEntropy);
+        return bounds.bounds(attSet, depth);
+    }
+
+    // Whether H(attSet) <= threshold. The exact entropy is only computed,
+    // through entropy(), when the bounds straddle the threshold.
+    bool entropyAtMost(const AttributeSet &attSet, double threshold) {
+        EntropyInterval interval = entropyBounds(attSet);
+        if (interval.upper <= threshold) {
+            return true;
+        }
+        if (interval.lower > threshold) {
+            return false;
+        }
+        return entropy(attSet) <= threshold;
+    }
+
+    // Whether lhs → rhs holds within epsilon bits: H(lhs ∪ rhs) - H(lhs) <=
+    // epsilon. Both entropies are computed only if their bounds cannot
+    // decide it.
+    bool dependencyHolds(const AttributeSet &lhs, const AttributeSet &rhs, double epsilon) {
+        AttributeSet both = lhs;
+        both |= rhs;
+        EntropyInterval joint = entropyBounds(both);
+        EntropyInterval left = entropyBounds(lhs);
+        if (joint.upper - left.lower <= epsilon) {
+            return true;
+        }
+        if (joint.lower - left.upper > epsilon) {
+            return false;
+        }
+        std::vector<double> exact = entropy(std::vector<AttributeSet>{both, lhs});
+        return exact[0] - exact[1] <= epsilon;
+    }
+
+    // Computes the entropies of exactly the targets, in physical attributes,
+    // and of the sets on the way to them, instead of the whole lattice.
+    // Targets sharing attributes share the partitions refined for them.
+    // Engines without an on-demand path (TIDCNT, BUC) mine every level up to
+    // the largest target instead. Results go into the same store as
+    // computeEntropies() and entropy().
+    void computeTargets(const std::vector<AttributeSet> &targets) {
+        std::vector<AttributeSet> missing = missingSets(targets);
+        if (!missing.empty()) {
+            computeTargetSets(missing);
+        }
+    }
+
+    // Minimal functional dependencies X → a found while mining, in physical
+    // attributes
+    std::vector<std::pair<AttributeSet, int>> getFunctionalDependencies() const {
+        std::vector<std::pair<AttributeSet, int>> dependencies;
+        for (int a = 0; a < attributeCount; a++) {
+            determinants[a]->forEach([&](const AttributeSet &lhs) {
+                dependencies.push_back({toPhysical.apply(lhs), attributeOrder[a]});
+            });
+        }
+        std::sort(dependencies.begin(), dependencies.end());
+        return dependencies;
+    }
+
+    std::vector<AttributeSet> getMinimalKeys() const {
+        std::vector<AttributeSet> keys;
+        entropies.forEachKey([&](const AttributeSet &key) {
+            keys.push_back(key);
+        });
+        std::sort(keys.begin(), keys.end());
+        return keys;
+    }
+
+    // Writes the mined entropies and minimal keys to an mmap-able file (see
+    // entropy_file.hpp), stamped with a fingerprint of the source CSV
+    void saveEntropies(const std::string &path, EntropyQuantization quantization = EntropyQuantization::Float64) const {
+        std::vector<std::pair<AttributeSet, double>> entries;
+        entries.reserve(entropies.size());
+        entropies.forEach([&](const AttributeSet &attSet, double entropy) {
+            entries.push_back({attSet, entropy});
+        });
+        EntropyFileWriter<AttributeSet>::write(path, entries, getMinimalKeys(), attributeCount, tupleCount, datasetFingerprint(csvPath), quantization);
+    }
+
     void printEntropies() {
-        for (const auto& [attSet, entropy] : entropies) {
+        std::vector<std::pair<AttributeSet, double>> sorted;
+        entropies.forEach([&](const AttributeSet &attSet, double entropy) {
+            sorted.push_back({attSet, entropy});
+        });
+        std::sort(sorted.begin(), sorted.end());
+        for (const auto& [attSet, entropy] : sorted) {
             std::cout << "Entropy for ";
             std::cout << toString(attSet) << " ";
             std::cout << entropy << "\n";
@@ -113,4 +477,27 @@ public:
 
 };
 
+// Runs fn on an Engine instantiated for the narrowest width that holds
+// attributeCount attributes
+template <template <int> class Engine, typename F>
+void withLatticeWidth(const std::string &csvPath, int attributeCount, F fn) {
+    switch (latticeWords(attributeCount)) {
+    case 1: {
+        Engine<1> engine(csvPath, attributeCount);
+        fn(engine);
+        break;
+    }
+    case 2: {
+        Engine<2> engine(csvPath, attributeCount);
+        fn(engine);
+        break;
+    }
+    default: {
+        Engine<4> engine(csvPath, attributeCount);
+        fn(engine);
+        break;
+    }
+    }
+}
+
 #endif // SCHEMA_MINER_HPP
\ No newline at end of file
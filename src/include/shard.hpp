@@ -0,0 +1,152 @@
+#ifndef SHARD_HPP
+#define SHARD_HPP
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Splits the attribute-set lattice between `count` shards by two-attribute
+// prefix. Every set of two or more attributes {a, b, ...} (a < b smallest)
+// lies in the sub-lattice rooted at {a, b}, which holds 2^(n-b-1) sets;
+// prefixes are dealt largest first to the least loaded shard, so every
+// process derives the same, roughly even, assignment on its own.
+class LatticeSharding {
+private:
+    int attributeCount;
+    int count;
+    std::vector<int> prefixOwner;
+
+public:
+    LatticeSharding(int attributeCount = 0, int count = 1) : attributeCount(attributeCount), count(std::max(1, count)) {
+        prefixOwner.assign(attributeCount * attributeCount, 0);
+        std::vector<std::pair<int, int>> prefixes;
+        for (int a = 0; a < attributeCount; a++) {
+            for (int b = a + 1; b < attributeCount; b++) {
+                prefixes.push_back({a, b});
+            }
+        }
+        // Subtree size only depends on b: the smaller b, the larger the subtree
+        std::stable_sort(prefixes.begin(), prefixes.end(), [](const std::pair<int, int> &x, const std::pair<int, int> &y) {
+            return x.second < y.second;
+        });
+
+        std::vector<double> load(this->count, 0);
+        for (const auto &prefix : prefixes) {
+            int shard = (int)(std::min_element(load.begin(), load.end()) - load.begin());
+            load[shard] += std::ldexp(1.0, attributeCount - prefix.second - 1);
+            prefixOwner[prefix.first * attributeCount + prefix.second] = shard;
+        }
+    }
+
+    int shardCount() const {
+        return count;
+    }
+
+    int ownerOfSingle(int a) const {
+        return a % count;
+    }
+
+    int ownerOfPrefix(int a, int b) const {
+        return prefixOwner[a * attributeCount + b];
+    }
+};
+
+// Shard files hold (attribute set, entropy) pairs and then the shard's
+// minimal keys, after a small header that records the key width, so shards
+// of different lattice widths don't mix, and the keys' entropy, log2 N
+const uint64_t SHARD_FILE_MAGIC = 0x4452414853494d53ULL; // "SMISHARD"
+
+template <typename Key>
+void writeShardFile(const std::string &path, const std::vector<std::pair<Key, double>> &entries, const std::vector<Key> &keys,
+                    double keyEntropy) {
+    // Write beside the target, sync and rename, so a crashed worker or host
+    // never leaves a truncated shard behind
+    std::string tmpPath = path + ".tmp";
+    FILE *file = std::fopen(tmpPath.c_str(), "wb");
+    if (file == nullptr) {
+        throw std::runtime_error("Could not create shard file " + tmpPath);
+    }
+    uint64_t header[4] = {SHARD_FILE_MAGIC, sizeof(Key), entries.size(), keys.size()};
+    std::fwrite(header, sizeof(header), 1, file);
+    std::fwrite(&keyEntropy, sizeof(keyEntropy), 1, file);
+    for (const auto &entry : entries) {
+        std::fwrite(&entry.first, sizeof(entry.first), 1, file);
+        std::fwrite(&entry.second, sizeof(entry.second), 1, file);
+    }
+    if (!keys.empty()) {
+        std::fwrite(keys.data(), sizeof(Key), keys.size(), file);
+    }
+    bool written = !std::ferror(file) && std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+    if (std::fclose(file) != 0 || !written || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        throw std::runtime_error("Could not write shard file " + path);
+    }
+}
+
+// Calls entry for every entry and then key for every minimal key, with its
+// entropy
+template <typename Key>
+void readShardFile(const std::string &path, const std::function<void(const Key &, double)> &entry,
+                   const std::function<void(const Key &, double)> &key) {
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        throw std::runtime_error("Could not open shard file " + path);
+    }
+    uint64_t header[4];
+    double keyEntropy;
+    if (std::fread(header, sizeof(header), 1, file) != 1 || header[0] != SHARD_FILE_MAGIC || header[1] != sizeof(Key) ||
+        std::fread(&keyEntropy, sizeof(keyEntropy), 1, file) != 1) {
+        std::fclose(file);
+        throw std::runtime_error("Malformed shard file " + path);
+    }
+    for (uint64_t i = 0; i < header[2] + header[3]; i++) {
+        Key attSet;
+        double entropy = keyEntropy;
+        if (std::fread(&attSet, sizeof(attSet), 1, file) != 1 || (i < header[2] && std::fread(&entropy, sizeof(entropy), 1, file) != 1)) {
+            std::fclose(file);
+            throw std::runtime_error("Truncated shard file " + path);
+        }
+        (i < header[2] ? entry : key)(attSet, entropy);
+    }
+    std::fclose(file);
+}
+
+// Starts a copy of this executable with the given arguments
+inline pid_t spawnWorker(const std::vector<std::string> &args) {
+    // Built before fork: the child may only make async-signal-safe calls
+    std::vector<char *> argv;
+    for (const auto &arg : args) {
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        throw std::runtime_error("Could not fork worker process");
+    }
+    if (pid == 0) {
+        execv("/proc/self/exe", argv.data());
+        _exit(127);
+    }
+    return pid;
+}
+
+inline bool waitWorker(pid_t pid) {
+    int status;
+    if (waitpid(pid, &status, 0) != pid) {
+        return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+#endif // SHARD_HPP
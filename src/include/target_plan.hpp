@@ -0,0 +1,119 @@
+#ifndef TARGET_PLAN_HPP
+#define TARGET_PLAN_HPP
+
+#include "attribute_set.hpp"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+// Plan for computing the entropies of a given workload of attribute sets
+// instead of the whole lattice. Targets are inserted into a trie, each with
+// its attributes in one global order, so targets sharing a prefix share the
+// partitions along it. Attributes used by more targets come first, which
+// makes shared prefixes longer.
+//
+// Only trie nodes that are targets or where paths fork are worth keeping a
+// partition for; the chain of attributes between two of them is refined in
+// one go. Those nodes become the steps of the plan.
+template <int Words>
+class TargetPlan {
+public:
+    using AttributeSet = AttributeMask<Words>;
+
+    struct Step {
+        AttributeSet attSet;
+        int parent;                   // Step refined from, or -1 for the empty set
+        std::vector<int> attributes;  // Added to the parent's set, in order
+        bool target;
+    };
+
+    // Parents come before their children
+    std::vector<Step> steps;
+
+    // rank[a] orders attributes within a path; smaller ranks first
+    static TargetPlan build(const std::vector<AttributeSet> &targets, const std::vector<int> &rank) {
+        struct TrieNode {
+            std::map<int, int> children;
+            bool target = false;
+        };
+        std::vector<TrieNode> trie(1);
+        for (const auto &target : targets) {
+            std::vector<int> path(target.begin(), target.end());
+            std::stable_sort(path.begin(), path.end(), [&rank](int a, int b) {
+                return rank[a] < rank[b];
+            });
+            int node = 0;
+            for (int att : path) {
+                auto it = trie[node].children.find(att);
+                if (it == trie[node].children.end()) {
+                    it = trie[node].children.emplace(att, (int)trie.size()).first;
+                    trie.emplace_back();
+                }
+                node = it->second;
+            }
+            trie[node].target = true;
+        }
+
+        TargetPlan plan;
+        if (trie[0].target) {
+            plan.steps.push_back({AttributeSet(), -1, {}, true});
+        }
+        struct Pending {
+            int node;
+            int step;  // Nearest kept ancestor
+            AttributeSet attSet;
+            std::vector<int> attributes;
+        };
+        std::vector<Pending> stack;
+        for (auto it = trie[0].children.rbegin(); it != trie[0].children.rend(); ++it) {
+            stack.push_back({it->second, -1, AttributeSet{it->first}, {it->first}});
+        }
+        while (!stack.empty()) {
+            Pending current = std::move(stack.back());
+            stack.pop_back();
+            const TrieNode &node = trie[current.node];
+            int step = current.step;
+            std::vector<int> attributes = current.attributes;
+            if (node.target || node.children.size() != 1) {
+                plan.steps.push_back({current.attSet, current.step, attributes, node.target});
+                step = (int)plan.steps.size() - 1;
+                attributes.clear();
+            }
+            for (auto it = node.children.rbegin(); it != node.children.rend(); ++it) {
+                AttributeSet attSet = current.attSet;
+                attSet.insert(it->first);
+                std::vector<int> path = attributes;
+                path.push_back(it->first);
+                stack.push_back({it->second, step, attSet, path});
+            }
+        }
+        return plan;
+    }
+
+    // Ranks attributes by how many targets use them, most first; ties go to
+    // the more selective attribute, by cardinality
+    static std::vector<int> rankByUse(const std::vector<AttributeSet> &targets, const std::vector<double> &cardinality) {
+        int attributeCount = (int)cardinality.size();
+        std::vector<int> uses(attributeCount, 0);
+        for (const auto &target : targets) {
+            for (int att : target) {
+                uses[att]++;
+            }
+        }
+        std::vector<int> order(attributeCount);
+        for (int a = 0; a < attributeCount; a++) {
+            order[a] = a;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+            return uses[a] != uses[b] ? uses[a] > uses[b] : cardinality[a] > cardinality[b];
+        });
+        std::vector<int> rank(attributeCount);
+        for (int r = 0; r < attributeCount; r++) {
+            rank[order[r]] = r;
+        }
+        return rank;
+    }
+};
+
+#endif // TARGET_PLAN_HPP
@@ -1,8 +1,161 @@
 #include "schema_miner.hpp"
+#include "partition.hpp"
+#include "compressed_partition.hpp"
+#include "shard.hpp"
+#include "partition_cache.hpp"
+#include "entropy_kernel.hpp"
+#include "level_traversal.hpp"
+#include "target_plan.hpp"
 
-class SchemaMinerTIDCNT : public SchemaMiner {
+template <int Words>
+class SchemaMinerTIDCNT : public SchemaMiner<Words> {
 private:
-    std::queue<std::pair<AttributeSet, int>> getFirstLevelEntropies() {
+    using Base = SchemaMiner<Words>;
+    using AttributeSet = typename Base::AttributeSet;
+    using Node = typename Base::Node;
+    using Base::db;
+    using Base::conn;
+    using Base::csvPath;
+    using Base::attributeCount;
+    using Base::tupleCount;
+    using Base::entropies;
+    using Base::threadCount;
+    using Base::getLogN;
+    using Base::setEntropy;
+    using Base::setKey;
+    using Base::coveredByKey;
+    using Base::budgetLevels;
+    using Base::startBudget;
+    using Base::watchBudget;
+    using Base::finishBudget;
+    using Base::computeTargetLevels;
+    using Base::columnCardinalities;
+    using Base::getTblName;
+    using Base::fixedCLogC;
+    using Base::readCLogCSum;
+
+    // Partial result of joining a node's TID table with a single attribute
+    struct JoinResult {
+        int piece = 0;
+        CLogCSum sum;
+        long long rows = 0;
+        long long classes = 0;
+    };
+
+    // Pieces of a node's join collected until the last one finishes
+    struct PendingJoin {
+        std::mutex lock;
+        int pieces = 1;
+        std::vector<JoinResult> parts;
+    };
+
+    std::vector<long long> columnRows;
+
+    // A node's TID table: a plain table, or a view over the tables of the
+    // pieces it was computed in
+    struct TidTable {
+        int pieces = 1;
+        std::vector<int> parts;
+    };
+
+    // Approximate footprint of one TID table row: a hashed value and a TID
+    static constexpr size_t TID_ROW_BYTES = 16;
+
+    using TableCache = PartitionCache<AttributeSet, TidTable, duckdb::Connection, AttributeMaskHash<Words>>;
+
+    // TID tables of nodes above level 1; the single-attribute tables are the
+    // base everything is rebuilt from and stay for the whole run
+    std::unique_ptr<TableCache> tables;
+    size_t cacheBudget = SIZE_MAX;
+
+    // Evicted tables are spilled as Parquet files here, if set
+    std::string spillDirectory;
+    size_t diskBudget = 0;
+
+    std::string getSpillPath(const AttributeSet &attSet) {
+        return spillDirectory + "/schema_miner_" + std::to_string(getpid()) + "_" + getTblName(attSet) + ".parquet";
+    }
+
+    size_t spillTable(duckdb::Connection &c, const AttributeSet &attSet, TidTable &table) {
+        std::string path = getSpillPath(attSet);
+        auto copy = executePending(c, "COPY (SELECT * FROM " + getTblName(attSet) + ") TO '" + path + "' (FORMAT parquet, COMPRESSION zstd);");
+        dropTable(c, attSet, table);
+        struct stat info;
+        if (copy->HasError() || stat(path.c_str(), &info) != 0) {
+            std::remove(path.c_str());
+            return 0;
+        }
+        return std::max<size_t>(1, info.st_size);
+    }
+
+    TidTable loadTable(duckdb::Connection &c, const AttributeSet &attSet, size_t &bytes) {
+        std::string tblName = getTblName(attSet);
+        std::string path = getSpillPath(attSet);
+        auto created = executePending(c, "CREATE TABLE " + tblName + " AS SELECT * FROM read_parquet('" + path + "');");
+        auto rows = created->HasError() ? std::move(created) : executePending(c, "SELECT COUNT(*) FROM " + tblName + ";");
+        std::remove(path.c_str());
+        if (rows->HasError()) {
+            // Missing or unreadable spill file: build the table again instead
+            c.Query("DROP TABLE IF EXISTS " + tblName + ";");
+            return rebuildTable(c, attSet, bytes);
+        }
+        bytes = rows->GetValue(0, 0).template GetValue<int64_t>() * TID_ROW_BYTES;
+        return TidTable();
+    }
+
+    void dropTable(duckdb::Connection &c, const AttributeSet &attSet, TidTable &table) {
+        std::string tblName = getTblName(attSet);
+        if (table.pieces == 1) {
+            c.Query("DROP TABLE IF EXISTS " + tblName + ";");
+            return;
+        }
+        c.Query("DROP VIEW IF EXISTS " + tblName + ";");
+        for (int part : table.parts) {
+            c.Query("DROP TABLE IF EXISTS " + getPieceName(tblName, part, table.pieces) + ";");
+        }
+    }
+
+    // Rebuilds an evicted TID table from its parent's, which is itself
+    // rebuilt first if it is gone too
+    TidTable rebuildTable(duckdb::Connection &c, const AttributeSet &attSet, size_t &bytes) {
+        int last = attSet.last();
+        AttributeSet parent = attSet;
+        parent.erase(last);
+        acquireTable(c, parent);
+        try {
+            std::string tblName = getTblName(attSet);
+            executeChecked(c,
+                "CREATE TABLE " + tblName + " AS (" +
+                "SELECT val, tid FROM (" +
+                "SELECT HASH(t1.val, t2.val) AS val, t1.tid AS tid, COUNT(*) OVER (PARTITION BY HASH(t1.val, t2.val)) AS cnt " +
+                "FROM " + getTblName(parent) + " AS t1, " + getTblName({last}) + " AS t2 " +
+                "WHERE t1.tid = t2.tid) AS j WHERE cnt > 1);"
+            );
+            auto rows = executeChecked(c, "SELECT COUNT(*) FROM " + tblName + ";");
+            bytes = rows->GetValue(0, 0).template GetValue<int64_t>() * TID_ROW_BYTES;
+        } catch (...) {
+            releaseTable(c, parent);
+            throw;
+        }
+        releaseTable(c, parent);
+        return TidTable();
+    }
+
+    void acquireTable(duckdb::Connection &c, const AttributeSet &attSet) {
+        if (attSet.size() > 1) {
+            tables->acquire(c, attSet, [this](duckdb::Connection &conn, const AttributeSet &set, size_t &bytes) {
+                return rebuildTable(conn, set, bytes);
+            });
+        }
+    }
+
+    void releaseTable(duckdb::Connection &c, const AttributeSet &attSet) {
+        if (attSet.size() > 1) {
+            tables->release(c, attSet);
+        }
+    }
+
+    std::vector<Node> getFirstLevelEntropies() {
         // Open the CSV file
         std::ifstream file(csvPath);
         if (!file.is_open()) {
@@ -39,12 +192,18 @@ private:
         file.close();
 
         tupleCount = columns[0].size();
+        columnCardinalities.assign(columns.size(), 0);
+        columnRows.assign(columns.size(), 0);
+        setEntropy({}, 0); // A single class of every row
 
-        std::queue<std::pair<AttributeSet, int>> q;
+        std::vector<Node> level;
+        Arena arena;
 
         for (int i = 0; i < columns.size(); i++) {
-            // Create TID table for column
+            // Create TID table for column, replacing one left by an earlier
+            // run on this connection (e.g. a repeated computeTargets())
             std::string tblName = getTblName({i});
+            conn.Query("DROP TABLE IF EXISTS " + tblName + ";");
             conn.Query("CREATE TABLE " + tblName + " (val VARCHAR(8), tid BIGINT);");
             std::string valIdx = "CREATE INDEX val_idx_" + tblName + " ON " + tblName + "(val);";
             conn.Query(valIdx);
@@ -52,12 +211,12 @@ private:
             conn.Query(tidIdx);
 
             auto column = columns[i];
-            std::map<int, AttributeSet> valueMap = {};
-            std::map<std::string, int> valueToKey;
+            std::map<std::string, uint32_t> valueToKey;
+            uint32_t *keys = arena.allocateArray<uint32_t>(column.size());
 
-            int key = 1;
+            uint32_t key = 1;
             // Iterate through each value
-            for (int j = 0; j < column.size(); j++) {
+            for (size_t j = 0; j < column.size(); j++) {
                 std::string value = column[j];
 
                 // If the value hasn't been encountered yet, assign a new key
@@ -65,41 +224,75 @@ private:
                     valueToKey[value] = key++;  // Assign a new key and increment
                 }
 
-                int assignedKey = valueToKey[value];
-                valueMap[assignedKey].insert(j + 1);
+                keys[j] = valueToKey[value];
+            }
+            columnCardinalities[i] = valueToKey.size();
+
+            // Group TIDs by key with a counting sort: the TIDs of key k are
+            // tids[starts[k], starts[k + 1])
+            uint64_t *starts = arena.allocateArray<uint64_t>(key + 1);
+            uint64_t *fill = arena.allocateArray<uint64_t>(key + 1);
+            uint64_t *tids = arena.allocateArray<uint64_t>(column.size());
+            std::fill(starts, starts + key + 1, 0);
+            for (size_t j = 0; j < column.size(); j++) {
+                starts[keys[j] + 1]++;
+            }
+            for (uint32_t k = 1; k <= key; k++) {
+                starts[k] += starts[k - 1];
+            }
+            std::copy(starts, starts + key + 1, fill);
+            for (size_t j = 0; j < column.size(); j++) {
+                tids[fill[keys[j]]++] = j + 1;
             }
 
             // Populate TID table with non-singleton values
-            for (const auto& pair : valueMap) {
-                if (pair.second.size() > 1) {
-                    for (const auto& idx : pair.second) {
-                        auto value = std::to_string(i) + ":" + std::to_string(pair.first);
-                        std::string insertQuery = "INSERT INTO " + tblName + " VALUES ('" + value + "', " + std::to_string(idx) + ");";
+            long long classes = 0;
+            for (uint32_t k = 1; k < key; k++) {
+                uint64_t size = starts[k + 1] - starts[k];
+                if (size > 1) {
+                    classes++;
+                    columnRows[i] += size;
+                    for (uint64_t t = starts[k]; t < starts[k + 1]; t++) {
+                        auto value = std::to_string(i) + ":" + std::to_string(k);
+                        std::string insertQuery = "INSERT INTO " + tblName + " VALUES ('" + value + "', " + std::to_string(tids[t]) + ");";
                         conn.Query(insertQuery);
                     }
                 }
             }
 
-            // Compute entropy for single attribute
-            auto qry = conn.Query("SELECT SUM(cnt) FROM (SELECT val, COUNT(*) * LOG2(COUNT(*)) AS cnt FROM " + tblName + " GROUP BY val) AS t;");
-            try {
-                auto entropy = qry->GetValue(0, 0).GetValue<double>();
-                entropies[{i}] = getLogN() - (entropy / tupleCount);
-                q.push({{i}, i});
-            } catch (const std::exception& e) {
-                // Catch NULL returns when there are no common values
+            // Every join reads this table, so a wrong row count would skew
+            // every entropy above it
+            auto stored = conn.Query("SELECT COUNT(*) FROM " + tblName + ";");
+            if (stored->HasError() || stored->GetValue(0, 0).template GetValue<int64_t>() != columnRows[i]) {
+                throw std::runtime_error("Could not build the TID table of attribute " + std::to_string(i));
+            }
+
+            // Compute entropy for single attribute from the group sizes
+            double entropy = sumClassCLogC(starts + 1, key - 1).value();
+            arena.release();
+            if (classes == 0) {
+                setKey({i}); // No common values
                 continue;
             }
+            setEntropy({i}, getLogN() - (entropy / tupleCount));
+            level.push_back({{i}, columnRows[i], classes});
         }
-        return q;
+        return level;
+    }
+
+    std::string getPieceName(const std::string &tblName, int piece, int pieces) {
+        return pieces == 1 ? tblName : tblName + "_P" + std::to_string(piece);
     }
 
-    int getEntropy(AttributeSet t1, AttributeSet t2) {
+    // Joins the TID tables of t1 and t2, keeping only the groups whose t1 value
+    // hashes into `piece` of `pieces`. Groups never straddle pieces, so partial
+    // results of all pieces add up to the full join.
+    int getEntropy(duckdb::Connection &conn, AttributeSet t1, AttributeSet t2, int piece, int pieces, JoinResult &result) {
         // Assume TID tables exist for t1 and t2
 
         // Check attributes don't overlap
         for (const auto& att : t1) {
-            if (t2.find(att) != t2.end()) {
+            if (t2.contains(att)) {
                 std::cerr << "Attributes overlap in t1 and t2\n";
                 return 1;
             }
@@ -108,97 +301,271 @@ private:
         // Compute joined CNT 
         auto tbl1 = getTblName(t1);
         auto tbl2 = getTblName(t2);
-        t1.insert(t2.begin(), t2.end());
-        auto joinedTbl = getTblName(t1);
-
-        conn.Query(
-            "CREATE TABLE CNT_" + joinedTbl + " AS (" +
-            "SELECT HASH(t1.val, t2.val) AS val, COUNT(*) AS cnt " +
-            "FROM " + tbl1 + " AS t1, " + tbl2 + " AS t2 " +
-            "WHERE t1.tid = t2.tid GROUP BY HASH(t1.val, t2.val) HAVING COUNT(*) > 1);"
-        );
-
-        if (conn.Query("SELECT COUNT(*) FROM CNT_" + joinedTbl + ";")->GetValue(0, 0).GetValue<int>() != 0) {
-            // Calculate entropy
-            auto entropy = conn.Query("SELECT SUM(cnt * LOG2(cnt)) FROM CNT_" + joinedTbl + ";")->GetValue(0, 0).GetValue<double>();
-            entropies[t1] = getLogN() - (entropy / tupleCount);
-
-            // Compute TID by hashing and joining tables
-            conn.Query(
-                "CREATE TABLE " + joinedTbl + " AS (" +
-                "SELECT HASH(t1.val, t2.val) AS val, t1.tid AS tid " +
-                "FROM " + tbl1 + " AS t1, " + tbl2 + " AS t2, CNT_" + joinedTbl + " AS c " +
-                "WHERE t1.tid = t2.tid AND HASH(t1.val, t2.val) = c.val);"
+        t1 |= t2;
+        auto joinedTbl = getPieceName(getTblName(t1), piece, pieces);
+        std::string pieceFilter = pieces == 1 ? "" :
+            " AND HASH(t1.val) % " + std::to_string(pieces) + " = " + std::to_string(piece);
+
+        try {
+            executeChecked(conn,
+                "CREATE TABLE CNT_" + joinedTbl + " AS (" +
+                "SELECT HASH(t1.val, t2.val) AS val, COUNT(*) AS cnt " +
+                "FROM " + tbl1 + " AS t1, " + tbl2 + " AS t2 " +
+                "WHERE t1.tid = t2.tid" + pieceFilter + " GROUP BY HASH(t1.val, t2.val) HAVING COUNT(*) > 1);"
             );
-            conn.Query("DROP TABLE CNT_" + joinedTbl + ";");
 
-            return 0;
+            auto counts = executeChecked(conn, "SELECT COUNT(*), SUM(cnt), SUM(" + fixedCLogC("cnt") + ") FROM CNT_" + joinedTbl + ";");
+            result.classes = counts->GetValue(0, 0).template GetValue<int64_t>();
+            if (result.classes != 0) {
+                result.rows = counts->GetValue(1, 0).template GetValue<int64_t>();
+                result.sum = readCLogCSum(counts->GetValue(2, 0));
+
+                // Compute TID by hashing and joining tables
+                executeChecked(conn,
+                    "CREATE TABLE " + joinedTbl + " AS (" +
+                    "SELECT HASH(t1.val, t2.val) AS val, t1.tid AS tid " +
+                    "FROM " + tbl1 + " AS t1, " + tbl2 + " AS t2, CNT_" + joinedTbl + " AS c " +
+                    "WHERE t1.tid = t2.tid AND HASH(t1.val, t2.val) = c.val);"
+                );
+            }
+        } catch (...) {
+            // Interrupted or failed: leave nothing half built behind
+            conn.Query("DROP TABLE IF EXISTS CNT_" + joinedTbl + ";");
+            conn.Query("DROP TABLE IF EXISTS " + joinedTbl + ";");
+            throw;
         }
         conn.Query("DROP TABLE CNT_" + joinedTbl + ";");
-        return 1;
+        return result.classes != 0 ? 0 : 1;
     }
-    
 
-public:
-    SchemaMinerTIDCNT(const std::string& csvPath, int attributeCount) : SchemaMiner(csvPath, attributeCount) {}
+    // After a stop, joins whose finish was skipped left their TID tables
+    // outside the cache; drops every table and view above level 1
+    void dropOrphanTables() {
+        const std::string above = "'TBL\\_%\\_%' ESCAPE '\\'";
+        auto views = conn.Query("SELECT view_name FROM duckdb_views() WHERE NOT internal AND view_name LIKE " + above + ";");
+        for (duckdb::idx_t r = 0; !views->HasError() && r < views->RowCount(); r++) {
+            conn.Query("DROP VIEW IF EXISTS " + views->GetValue(0, r).ToString() + ";");
+        }
+        auto tables = conn.Query("SELECT table_name FROM duckdb_tables() WHERE table_name LIKE " + above +
+                                 " OR table_name LIKE 'CNT\\_%' ESCAPE '\\';");
+        for (duckdb::idx_t r = 0; !tables->HasError() && r < tables->RowCount(); r++) {
+            conn.Query("DROP TABLE IF EXISTS " + tables->GetValue(0, r).ToString() + ";");
+        }
+    }
 
-    void computeEntropies() override {
-        std::queue<std::pair<AttributeSet, int>> q = getFirstLevelEntropies();
-    
+    // Join inputs plus an estimate of the aggregation's group count
+    double estimateCost(const Node &parent, int att) {
+        return parent.rows + columnRows[att] +
+            std::min<double>(parent.rows, (double)parent.classes * columnCardinalities[att]);
+    }
 
-        while (!q.empty()) {
-            auto [attSet, last] = q.front();
-            q.pop();
+    // Queues the children of a node; each child queues its own children as
+    // soon as its TID table exists, without waiting for the rest of its level
+    void submitChildren(LatticeScheduler &scheduler, const Node &node) {
+        if (node.attSet.size() >= budgetLevels()) {
+            return;
+        }
+        int last = node.attSet.last();
+        for (int i = last+1; i < attributeCount; i++) {
+            auto newAttSet = node.attSet;
+            newAttSet.insert(i);
+            auto join = std::make_shared<PendingJoin>();
 
-            if (last == attributeCount) {
-                continue;
-            }
+            LatticeTask task;
+            task.cost = estimateCost(node, i);
+            task.splittable = true;
+            task.run = [this, node, i, newAttSet, join](duckdb::Connection &c, int piece, int pieces) {
+                if (coveredByKey(newAttSet)) {
+                    return; // Implied by a key found since this was queued
+                }
+                JoinResult result;
+                result.piece = piece;
+                acquireTable(c, node.attSet);
+                int status;
+                try {
+                    status = getEntropy(c, node.attSet, {i}, piece, pieces, result);
+                } catch (...) {
+                    releaseTable(c, node.attSet);
+                    throw;
+                }
+                releaseTable(c, node.attSet);
+                std::lock_guard<std::mutex> guard(join->lock);
+                join->pieces = pieces;
+                if (status == 0) {
+                    join->parts.push_back(result);
+                }
+            };
+            task.finish = [this, node, i, newAttSet, join, &scheduler](duckdb::Connection &c) {
+                tables->childDone(c, node.attSet);
+                if (join->parts.empty()) {
+                    setKey(newAttSet);
+                    return;
+                }
+                JoinResult total;
+                for (const auto& part : join->parts) {
+                    total.sum += part.sum;
+                    total.rows += part.rows;
+                    total.classes += part.classes;
+                }
+                double entropy = getLogN() - (total.sum.value() / tupleCount);
+                scheduler.fold([this, newAttSet, entropy] {
+                    setEntropy(newAttSet, entropy);
+                });
 
-            for (int i = last+1; i < attributeCount; i++) {
-                if (getEntropy(attSet, {i}) == 0) {
-                    auto newAttSet = attSet;
-                    newAttSet.insert(i);
-                    q.push({newAttSet, i});
+                // Split nodes expose their pieces as a single TID table
+                if (join->pieces > 1) {
+                    std::string tblName = getTblName(newAttSet);
+                    std::string view;
+                    for (const auto& part : join->parts) {
+                        view += (view.empty() ? "" : " UNION ALL ") + std::string("SELECT * FROM ") + getPieceName(tblName, part.piece, join->pieces);
+                    }
+                    c.Query("CREATE VIEW " + tblName + " AS " + view + ";");
                 }
-            }
+
+                TidTable table;
+                table.pieces = join->pieces;
+                for (const auto& part : join->parts) {
+                    table.parts.push_back(part.piece);
+                }
+                int children = newAttSet.size() < budgetLevels() ? attributeCount - i - 1 : 0;
+                tables->insert(c, newAttSet, table, total.rows * TID_ROW_BYTES, estimateCost(node, i), children);
+
+                submitChildren(scheduler, {newAttSet, total.rows, total.classes});
+            };
+            scheduler.submit(std::move(task));
+        }
+    }
+
+    // No on-demand path: mines every level up to the largest target
+    void computeTargetSets(const std::vector<AttributeSet> &targets) override {
+        computeTargetLevels(targets);
+    }
+
+public:
+    SchemaMinerTIDCNT(const std::string& csvPath, int attributeCount) : Base(csvPath, attributeCount) {}
+
+    // Byte budget for TID tables above level 1. Tables are dropped once all
+    // children of their node are computed; above the budget, tables still
+    // needed are evicted and rebuilt from their nearest cached ancestor.
+    void setCacheBudget(size_t bytes) {
+        cacheBudget = bytes;
+    }
+
+    // Spill evicted TID tables to `directory` (ideally local SSD), using at
+    // most diskBytes there, and read them back instead of rebuilding them
+    void setSpillDirectory(const std::string &directory, size_t diskBytes) {
+        spillDirectory = directory;
+        diskBudget = diskBytes;
+    }
+
+    // Under a budget, nodes are still pipelined rather than mined level by
+    // level, so a run cut short by time or memory only completes level 1
+    void computeEntropies() override {
+        startBudget();
+        tables.reset(new TableCache(cacheBudget, [this](duckdb::Connection &c, const AttributeSet &attSet, TidTable &table) {
+            dropTable(c, attSet, table);
+        }));
+        if (!spillDirectory.empty()) {
+            tables->setDiskTier(diskBudget,
+                [this](duckdb::Connection &c, const AttributeSet &attSet, TidTable &table) {
+                    return spillTable(c, attSet, table);
+                },
+                [this](duckdb::Connection &c, const AttributeSet &attSet, size_t &bytes) {
+                    return loadTable(c, attSet, bytes);
+                },
+                [this](duckdb::Connection &, const AttributeSet &attSet) {
+                    std::remove(getSpillPath(attSet).c_str());
+                });
         }
+        std::vector<Node> level = getFirstLevelEntropies();
+        LatticeScheduler scheduler(db, threadCount);
+        watchBudget(scheduler);
+
+        for (const auto& node : level) {
+            submitChildren(scheduler, node);
+        }
+        scheduler.drain();
+        tables->clear(conn);
+        if (scheduler.stopped()) {
+            dropOrphanTables();
+        }
+        finishBudget(scheduler.stopped() ? 1 : budgetLevels());
     }
 };
 
-class SchemaMinerBUC : public SchemaMiner {
+template <int Words>
+class SchemaMinerBUC : public SchemaMiner<Words> {
 private:
+    using Base = SchemaMiner<Words>;
+    using AttributeSet = typename Base::AttributeSet;
+    using Node = typename Base::Node;
+    using Base::db;
+    using Base::conn;
+    using Base::csvPath;
+    using Base::attributeCount;
+    using Base::tupleCount;
+    using Base::entropies;
+    using Base::threadCount;
+    using Base::getLogN;
+    using Base::setEntropy;
+    using Base::setKey;
+    using Base::coveredByKey;
+    using Base::budgetLevels;
+    using Base::startBudget;
+    using Base::budgetExhausted;
+    using Base::finishBudget;
+    using Base::computeTargetLevels;
+    using Base::strHasher;
+    using Base::intHasher;
+    using Base::reorderColumns;
+    using Base::getColumnName;
+    using Base::fixedCLogC;
+    using Base::readCLogCSum;
+
+    // Σ c·log2(c) per attribute set, accumulated as groups are counted; the
+    // order the groups come back in does not change the fixed-point sums
+    std::unordered_map<AttributeSet, CLogCSum, AttributeMaskHash<Words>> sums;
+
+    // Sets reached from a parent with common values. Every group of such a
+    // set with two or more rows is counted under some parent group, so one
+    // that never got a count is a key.
+    std::unordered_set<AttributeSet, AttributeMaskHash<Words>> attempted;
+
     void runBUCFilter(const std::string& tblName, AttributeSet attSet, const std::string& filter = "") {
-        int prevPartitionAtt = attSet.empty() ? -1 : *attSet.rbegin();
+        int prevPartitionAtt = attSet.last();
 
         for (int i = prevPartitionAtt + 1; i < attributeCount; i++) {
+            if (budgetExhausted()) {
+                return;
+            }
             AttributeSet nextAttSet = attSet;
             nextAttSet.insert(i);
+            attempted.insert(nextAttSet);
 
-            // If we're at the last attribute, count rather than recurse
-            if (i == attributeCount - 1) {
+            // At the last attribute or the level limit, count rather than recurse
+            if (i == attributeCount - 1 || nextAttSet.size() == budgetLevels()) {
                 std::string qryStr = "SELECT SUM(cnt) FROM ("
-                    "SELECT col" + std::to_string(i) + 
-                    ", COUNT(*) * LOG2(COUNT(*)) AS cnt "
+                    "SELECT " + getColumnName(i) + 
+                    ", " + fixedCLogC("COUNT(*)") + " AS cnt "
                     "FROM " + tblName + 
                     (filter.empty() ? "" : " WHERE " + filter) +
-                    " GROUP BY col" + std::to_string(i) +
+                    " GROUP BY " + getColumnName(i) +
                     " HAVING COUNT(*) > 1) AS t;";
                 auto qry = conn.Query(qryStr);
                 try {
-                    auto cnt = qry->GetValue(0, 0).GetValue<double>();
-                    entropies[nextAttSet] += cnt;
+                    sums[nextAttSet] += readCLogCSum(qry->GetValue(0, 0));
                 } catch (const std::exception& e) {
                     // Catch NULL returns when there are no common values
                     continue;
                 }
-                return;
+                continue;
             }
 
             // Get common values of the partition attribute 
-            std::string qryStr = "SELECT col" + std::to_string(i) + " "
+            std::string qryStr = "SELECT " + getColumnName(i) + " "
                 "FROM " + tblName + 
                 (filter.empty() ? "" : " WHERE " + filter) +
-                " GROUP BY col" + std::to_string(i) +
+                " GROUP BY " + getColumnName(i) +
                 " HAVING COUNT(*) > 1;";
             auto query = conn.Query(qryStr);
 
@@ -207,7 +574,7 @@ private:
             }
 
             std::vector<std::string> commonValues;
-            for (int j = 0; j < query->RowCount(); j++) {
+            for (duckdb::idx_t j = 0; j < query->RowCount(); j++) {
                 commonValues.push_back(query->GetValue(0, j).ToString());
             }
 
@@ -215,13 +582,13 @@ private:
             for (const auto& val : commonValues) {
                 // Extend filtering condition 
                 std::string newFilter = (filter.empty() ? "" : filter + " AND ") +
-                    "col" + std::to_string(i) + " = '" + val + "'";
+                    getColumnName(i) + " = '" + val + "'";
 
                 // Count distinct values 
                 std::string cntQryStr = "SELECT COUNT(*) FROM " + tblName + 
                     " WHERE " + newFilter + ";";
-                auto cnt = conn.Query(cntQryStr)->GetValue(0, 0).GetValue<int>();
-                entropies[nextAttSet] += (cnt * log2(cnt));
+                auto cnt = conn.Query(cntQryStr)->GetValue(0, 0).template GetValue<int64_t>();
+                sums[nextAttSet].addTerm(cLogC(cnt));
 
                 // Recurse
                 runBUCFilter(tblName, nextAttSet, newFilter);
@@ -232,28 +599,31 @@ private:
     void runBUC(const std::string& tblName, AttributeSet attSet) {
         // std::cout << "Running BUC on table: " << tblName << " with attributes: " << toString(attSet) << '\n';
         // Iterate through possible partitionAtts remaining 
-        int prevPartitionAtt = attSet.empty() ? -1 : *attSet.rbegin(); 
+        int prevPartitionAtt = attSet.last(); 
 
         for (int i = prevPartitionAtt + 1; i < attributeCount; i++) {
             // std::cout << "Partitioning on attribute: " << i << '\n';
+            if (budgetExhausted()) {
+                return;
+            }
             AttributeSet nextAttSet = attSet;
             nextAttSet.insert(i);
+            attempted.insert(nextAttSet);
             
-            // If we're at the last attribute, just count rather than partition
-            if (i == attributeCount-1) {
-                auto qry = conn.Query("SELECT SUM(cnt) FROM (SELECT col" + std::to_string(i) + ", COUNT(*) * LOG2(COUNT(*)) AS cnt FROM " + tblName + " GROUP BY col" + std::to_string(i) + " HAVING COUNT(*) > 1) AS t;");
+            // At the last attribute or the level limit, just count rather than partition
+            if (i == attributeCount-1 || nextAttSet.size() == budgetLevels()) {
+                auto qry = conn.Query("SELECT SUM(cnt) FROM (SELECT " + getColumnName(i) + ", " + fixedCLogC("COUNT(*)") + " AS cnt FROM " + tblName + " GROUP BY " + getColumnName(i) + " HAVING COUNT(*) > 1) AS t;");
                 try {
-                    auto cnt = qry->GetValue(0, 0).GetValue<double>();
-                    entropies[nextAttSet] += cnt;
+                    sums[nextAttSet] += readCLogCSum(qry->GetValue(0, 0));
                 } catch (const std::exception& e) {
                     // Catch NULL returns when there are no common values
                     continue;
                 }
-                return;
+                continue;
             }
             
             // Get common values of the partition attribute 
-            auto query = conn.Query("SELECT col" + std::to_string(i) + " FROM " + tblName + " GROUP BY col" + std::to_string(i) + " HAVING COUNT(*) > 1;");
+            auto query = conn.Query("SELECT " + getColumnName(i) + " FROM " + tblName + " GROUP BY " + getColumnName(i) + " HAVING COUNT(*) > 1;");
             if (query->RowCount() == 0) {
                 // std::cout << "No common values found for attribute: " << i << "\n";
                 continue; // Exit early if no common values
@@ -261,7 +631,7 @@ private:
 
             std::vector<std::string> commonValues;
             // std::cout << "Common values for attribute " << i << ": ";
-            for (int j = 0; j < query->RowCount(); j++) {
+            for (duckdb::idx_t j = 0; j < query->RowCount(); j++) {
                 // std::cout << query->GetValue(0, j).ToString() << " ";
                 commonValues.push_back(query->GetValue(0, j).ToString());
             }
@@ -273,16 +643,16 @@ private:
                 // std::cout << "Creating temporary table: " << temp << " for value: " << val << '\n';
                 conn.Query(
                     "CREATE TABLE " + temp + 
-                    " AS SELECT * EXCLUDE (col" + std::to_string(i) + 
+                    " AS SELECT * EXCLUDE (" + getColumnName(i) + 
                     ") FROM " + tblName + 
-                    " WHERE col" + std::to_string(i) + " = '" + val + "';"
+                    " WHERE " + getColumnName(i) + " = '" + val + "';"
                 );
                 // conn.Query("SELECT * FROM " + temp + ";")->Print();
 
                 // Get count of distinct values 
-                auto cnt = conn.Query("SELECT COUNT(*) FROM " + temp + ";")->GetValue(0, 0).GetValue<int>();
+                auto cnt = conn.Query("SELECT COUNT(*) FROM " + temp + ";")->GetValue(0, 0).template GetValue<int64_t>();
                 // std::cout << "Adding count: " << (cnt * log2(cnt)) << " to entropy of " << toString(nextAttSet) << '\n';
-                entropies[nextAttSet] += (cnt * log2(cnt));
+                sums[nextAttSet].addTerm(cLogC(cnt));
 
                 // Recurse
                 runBUC(temp, nextAttSet);
@@ -292,10 +662,18 @@ private:
         }
     }
 
+    // No on-demand path: mines every level up to the largest target
+    void computeTargetSets(const std::vector<AttributeSet> &targets) override {
+        computeTargetLevels(targets);
+    }
+
 public:
-    SchemaMinerBUC(const std::string& csvPath, int attributeCount) : SchemaMiner(csvPath, attributeCount) {}
+    SchemaMinerBUC(const std::string& csvPath, int attributeCount) : Base(csvPath, attributeCount) {}
 
+    // A set's sum is only complete once the whole cube has been walked, so a
+    // run cut short by time or memory keeps nothing; maxLevel is exact
     void computeEntropies() override {
+        startBudget();
         // Insert data 
         std::string query = "CREATE TABLE data AS SELECT * FROM read_csv('" + csvPath + "', header=false, names=[";
         for (int i = 0; i < attributeCount; i++) {
@@ -307,61 +685,241 @@ public:
         query += "]);";
         conn.Query(query);
 
-        tupleCount = conn.Query("SELECT COUNT(*) FROM data;")->GetValue(0, 0).GetValue<int>();
+        tupleCount = conn.Query("SELECT COUNT(*) FROM data;")->GetValue(0, 0).template GetValue<int64_t>();
 
         reorderColumns();
 
         // Start
         runBUCFilter("data", {});
+        if (budgetExhausted()) {
+            sums.clear();
+            attempted.clear();
+            finishBudget(0);
+            return;
+        }
 
         // Convert raw counts to entropies 
-        for (const auto& [attSet, entropy] : entropies) {
-            entropies[attSet] = getLogN() - (entropy / tupleCount);
+        for (const auto& [attSet, sum] : sums) {
+            setEntropy(attSet, getLogN() - (sum.value() / tupleCount));
         }
-
+        for (const auto& attSet : attempted) {
+            if (sums.count(attSet) == 0) {
+                setKey(attSet);
+            }
+        }
+        sums.clear();
+        attempted.clear();
+        finishBudget(budgetLevels());
     }
 };
 
-class SchemaMinerSimple : public SchemaMiner {
+template <int Words>
+class SchemaMinerSimple : public SchemaMiner<Words> {
 private:
-    bool computeEntropy(const AttributeSet& attSet) {
+    using Base = SchemaMiner<Words>;
+    using AttributeSet = typename Base::AttributeSet;
+    using Node = typename Base::Node;
+    using Base::db;
+    using Base::conn;
+    using Base::csvPath;
+    using Base::attributeCount;
+    using Base::tupleCount;
+    using Base::entropies;
+    using Base::threadCount;
+    using Base::getLogN;
+    using Base::setEntropy;
+    using Base::setKey;
+    using Base::coveredByKey;
+    using Base::budgeted;
+    using Base::budgetLevels;
+    using Base::startBudget;
+    using Base::watchBudget;
+    using Base::finishBudget;
+    using Base::addDependency;
+    using Base::isDetermined;
+    using Base::knownEntropy;
+    using Base::columnCardinalities;
+    using Base::loadColumnCardinalities;
+    using Base::getColumnName;
+    using Base::fixedCLogC;
+    using Base::readCLogCSum;
+
+    // Partial aggregate over the groups of one piece of a node
+    struct GroupResult {
+        bool found = false;
+        CLogCSum sum;
+        long long rows = 0;
+        long long classes = 0;
+    };
+
+    struct PendingGroup {
+        std::mutex lock;
+        GroupResult total;
+
+        void add(const GroupResult &result) {
+            if (result.found) {
+                std::lock_guard<std::mutex> guard(lock);
+                total.found = true;
+                total.sum += result.sum;
+                total.rows += result.rows;
+                total.classes += result.classes;
+            }
+        }
+    };
+
+    bool levelwise = false;
+    bool loaded = false;
+
+    // Depth-first mode over stripped partitions instead of queries
+    bool partitionStack = false;
+    std::unique_ptr<EncodedRelation> relation;
+
+    // The partitions along one worker's current path, one per depth. Each
+    // depth refines into its own arena, which is reset when the next sibling
+    // replaces the frame, so nothing outlives its subtree. A child with the
+    // same partition as its parent points at the parent's frame.
+    struct PartitionStack {
+        std::vector<Arena> arenas;
+        std::vector<StrippedPartition> owned;
+        std::vector<const StrippedPartition *> path;
+
+        explicit PartitionStack(int depth) : arenas(depth + 1), owned(depth + 1), path(depth + 1, nullptr) {}
+    };
+
+    // Aggregates the groups of attSet whose first attribute hashes into
+    // `piece` of `pieces`; a group never spans two pieces.
+    GroupResult computeEntropy(duckdb::Connection &conn, const AttributeSet& attSet, int piece = 0, int pieces = 1) {
         std::string qry;
         if (attSet.empty()) {
-            qry = "SELECT COUNT(*) * LOG2(COUNT(*)) FROM data;";
+            qry = "SELECT " + fixedCLogC("COUNT(*)") + ", COUNT(*), 1 FROM data;";
         } else {
-            qry = "SELECT SUM(cnt) FROM (SELECT COUNT(*) * LOG2(COUNT(*)) AS cnt FROM data GROUP BY ";
+            std::string groupBy;
             for (const auto& att : attSet) {
-                qry += "col" + std::to_string(att) + ", ";
+                groupBy += getColumnName(att) + ", ";
             }
-            qry.pop_back(); // Remove trailing comma and space
-            qry.pop_back();
-            qry += " HAVING COUNT(*) > 1) AS t;";
+            groupBy.pop_back(); // Remove trailing comma and space
+            groupBy.pop_back();
+            std::string pieceFilter = pieces == 1 ? "" :
+                " WHERE HASH(" + getColumnName(attSet.first()) + ") % " + std::to_string(pieces) + " = " + std::to_string(piece);
+            qry = "SELECT SUM(" + fixedCLogC("cnt") + "), SUM(cnt), COUNT(*) FROM (SELECT COUNT(*) AS cnt FROM data" + pieceFilter +
+                " GROUP BY " + groupBy + " HAVING COUNT(*) > 1) AS t;";
         }
 
-        try {
-            auto cnt = conn.Query(qry)->GetValue(0, 0).GetValue<double>();
-            entropies[attSet] = getLogN() - (cnt / tupleCount);
-            return true;
-        } catch (const std::exception&) {
-            return false; // Failure, prune this branch
+        GroupResult result;
+        auto res = executeChecked(conn, qry);
+        duckdb::Value sum = res->GetValue(0, 0);
+        if (sum.IsNull()) {
+            return result; // No common values in this piece
         }
+        result.sum = readCLogCSum(sum);
+        result.rows = res->GetValue(1, 0).template GetValue<int64_t>();
+        result.classes = res->GetValue(2, 0).template GetValue<int64_t>();
+        result.found = true;
+        return result;
     }
 
-    void recurseAttSets(int limit, int start, AttributeSet currSet) {
-        if (!computeEntropy(currSet)) {
-            return;
+    // Every child re-aggregates the base table; the parent's stripped
+    // partition and the new column's cardinality bound the group count
+    double estimateCost(const Node &parent, int att) {
+        return (double)tupleCount * (parent.attSet.size() + 1) +
+            std::min<double>(parent.rows, (double)parent.classes * columnCardinalities[att]);
+    }
+
+    // Queues the children of a node; each child is expanded as soon as it
+    // finishes instead of at the end of its level. A child implied by a known
+    // dependency shares the node's groups and is expanded without a query.
+    void submitChildren(LatticeScheduler &scheduler, int limit, int start, const Node &node) {
+        int first = node.attSet.empty() ? start : std::max(start, node.attSet.last() + 1);
+        for (int i = first; i < limit; ++i) {
+            auto newAttSet = node.attSet;
+            newAttSet.insert(i);
+            if (isDetermined(node.attSet, i)) {
+                double entropy = node.entropy;
+                scheduler.fold([this, newAttSet, entropy] {
+                    setEntropy(newAttSet, entropy);
+                });
+                submitChildren(scheduler, limit, start, {newAttSet, node.rows, node.classes, node.entropy});
+                continue;
+            }
+            auto group = std::make_shared<PendingGroup>();
+
+            LatticeTask task;
+            task.cost = estimateCost(node, i);
+            task.splittable = true;
+            task.run = [this, newAttSet, group](duckdb::Connection &c, int piece, int pieces) {
+                if (!coveredByKey(newAttSet)) {
+                    group->add(computeEntropy(c, newAttSet, piece, pieces));
+                }
+            };
+            task.finish = [this, limit, start, node, i, newAttSet, group, &scheduler](duckdb::Connection &) {
+                if (!group->total.found) {
+                    setKey(newAttSet); // No common values, prune this branch
+                    return;
+                }
+                Node child = childNode(node, i, group->total);
+                scheduler.fold([this, child] {
+                    setEntropy(child.attSet, child.entropy);
+                });
+                submitChildren(scheduler, limit, start, child);
+            };
+            scheduler.submit(std::move(task));
         }
-        for (int i = start; i < limit;  ++i) {
-            currSet.insert(i);
-            recurseAttSets(limit, i + 1, currSet);
-            currSet.erase(i);
+    }
+
+    // The child of parent by attribute i whose groups came to total. Grouping
+    // by one more column only splits groups or drops rows from them, so the
+    // same shape means the same groups: parent's attributes determine i.
+    Node childNode(const Node &parent, int i, const GroupResult &total) {
+        auto attSet = parent.attSet;
+        attSet.insert(i);
+        if (total.rows == parent.rows && total.classes == parent.classes) {
+            addDependency(parent.attSet, i);
         }
+        return {attSet, total.rows, total.classes, getLogN() - (total.sum.value() / tupleCount)};
     }
 
-public:
-    SchemaMinerSimple(const std::string& csvPath, int attributeCount) : SchemaMiner(csvPath, attributeCount) {}
+    // One runLevel() batch per lattice level, from the empty set down to the
+    // budget's level limit; returns the last level completed
+    int computeLevels(LatticeScheduler &scheduler, const Node &root) {
+        using Traversal = LevelTraversal<Words, Node>;
+        auto expand = [this, &scheduler](const std::vector<typename Traversal::Entry> &level,
+                                         const std::vector<typename Traversal::Candidate> &candidates,
+                                         std::vector<std::optional<Node>> &results) {
+            std::vector<PendingGroup> groups(candidates.size());
+            std::vector<LatticeTask> tasks;
+            for (size_t c = 0; c < candidates.size(); c++) {
+                const Node &parent = level[candidates[c].parent].state;
+                if (isDetermined(parent.attSet, candidates[c].attribute)) {
+                    setEntropy(candidates[c].attSet, parent.entropy);
+                    results[c] = Node{candidates[c].attSet, parent.rows, parent.classes, parent.entropy};
+                    continue;
+                }
+                LatticeTask task;
+                task.cost = estimateCost(parent, candidates[c].attribute);
+                task.splittable = true;
+                task.run = [this, &candidates, &groups, c](duckdb::Connection &conn, int piece, int pieces) {
+                    groups[c].add(computeEntropy(conn, candidates[c].attSet, piece, pieces));
+                };
+                task.finish = [this, &candidates, &groups, &results, &parent, c](duckdb::Connection &) {
+                    const GroupResult &total = groups[c].total;
+                    if (total.found) {
+                        results[c] = childNode(parent, candidates[c].attribute, total);
+                        setEntropy(candidates[c].attSet, results[c]->entropy);
+                    } else {
+                        setKey(candidates[c].attSet);
+                    }
+                };
+                tasks.push_back(std::move(task));
+            }
+            return scheduler.runLevel(tasks);
+        };
+        return Traversal::run(attributeCount, {{root.attSet, root}}, expand, nullptr, budgetLevels());
+    }
 
-    void computeEntropies() override {
+    void loadData() {
+        if (loaded) {
+            return;
+        }
         // Insert data 
         std::string query = "CREATE TABLE data AS SELECT * FROM read_csv('" + csvPath + "', header=false, names=[";
         for (int i = 0; i < attributeCount; i++) {
@@ -373,29 +931,938 @@ public:
         query += "]);";
         conn.Query(query);
 
-        tupleCount = conn.Query("SELECT COUNT(*) FROM data;")->GetValue(0, 0).GetValue<int>();
+        tupleCount = conn.Query("SELECT COUNT(*) FROM data;")->GetValue(0, 0).template GetValue<int64_t>();
+        loadColumnCardinalities();
+        loaded = true;
+    }
 
+    // attSet less the attributes that recorded dependencies determine from
+    // the rest of it; dropping them leaves the entropy unchanged
+    AttributeSet reduceByDependencies(const AttributeSet &attSet) const {
+        AttributeSet reduced = attSet;
+        for (int a : attSet) {
+            AttributeSet rest = reduced;
+            rest.erase(a);
+            if (isDetermined(rest, a)) {
+                reduced = rest;
+            }
+        }
+        return reduced;
+    }
+
+    // A set whose dependency-reduced subset is already known takes that
+    // entropy. This engine keeps no partitions or grouped tables to refine
+    // from, so every other set is one GROUP BY over the base table, all of
+    // them in one batch.
+    void computeOnDemand(const std::vector<AttributeSet> &attSets) override {
+        loadData();
+        LatticeScheduler scheduler(db, threadCount);
+        std::vector<PendingGroup> groups(attSets.size());
+        std::vector<LatticeTask> tasks;
+        for (size_t c = 0; c < attSets.size(); c++) {
+            if (coveredByKey(attSets[c])) {
+                continue;
+            }
+            double entropy;
+            AttributeSet reduced = reduceByDependencies(attSets[c]);
+            if (reduced != attSets[c] && knownEntropy(reduced, entropy)) {
+                setEntropy(attSets[c], entropy);
+                continue;
+            }
+            LatticeTask task;
+            task.cost = (double)tupleCount * (attSets[c].size() + 1);
+            task.splittable = !attSets[c].empty();
+            task.run = [this, &attSets, &groups, c](duckdb::Connection &conn, int piece, int pieces) {
+                groups[c].add(computeEntropy(conn, attSets[c], piece, pieces));
+            };
+            task.finish = [this, &attSets, &groups, c](duckdb::Connection &) {
+                const GroupResult &total = groups[c].total;
+                if (total.found) {
+                    setEntropy(attSets[c], getLogN() - (total.sum.value() / tupleCount));
+                } else {
+                    setKey(attSets[c]);
+                }
+            };
+            tasks.push_back(std::move(task));
+        }
+        scheduler.runLevel(tasks);
+    }
+
+    // Visits the children of attSet, whose partition is stack.path[depth]:
+    // each one is that partition intersected with one more column
+    void descend(PartitionStack &stack, const AttributeSet &attSet, int depth) {
+        const StrippedPartition &parent = *stack.path[depth];
+        double parentEntropy = getLogN() - (parent.sumCLogC / tupleCount);
+        for (int i = attSet.last() + 1; i < attributeCount; i++) {
+            auto child = attSet;
+            child.insert(i);
+            if (coveredByKey(child)) {
+                continue; // A key found in another branch implies the whole subtree
+            }
+            bool leaf = i + 1 == attributeCount;
+            if (isDetermined(attSet, i)) {
+                setEntropy(child, parentEntropy);
+                stack.path[depth + 1] = &parent;
+            } else {
+                Arena &arena = stack.arenas[depth + 1];
+                arena.reset();
+                StrippedPartition refined = refinePartition(parent, relation->column(i), relation->cardinality(i), &arena);
+                if (refined.classCount() == 0) {
+                    setKey(child); // No common values, prune this branch
+                    continue;
+                }
+                setEntropy(child, getLogN() - (refined.sumCLogC / tupleCount));
+                if (refined.rowCount() == parent.rowCount() && refined.classCount() == parent.classCount()) {
+                    addDependency(attSet, i);
+                    stack.path[depth + 1] = &parent;
+                } else {
+                    stack.owned[depth + 1] = std::move(refined);
+                    stack.path[depth + 1] = &stack.owned[depth + 1];
+                }
+            }
+            if (!leaf) {
+                descend(stack, child, depth + 1);
+            }
+        }
+    }
+
+    // One task per first attribute, each walking its subtree depth-first
+    // with a stack of its own; memory stays within O(n · N) rows per worker
+    void computeDepthFirst() {
+        relation.reset(new EncodedRelation(EncodedRelation::fromCsv(csvPath, attributeCount, false)));
+        tupleCount = relation->tuples();
+        setEntropy({}, 0); // A single class of every row
+
+        LatticeScheduler scheduler(db, threadCount);
+        std::vector<LatticeTask> tasks;
+        for (int i = 0; i < attributeCount; i++) {
+            LatticeTask task;
+            task.cost = std::ldexp((double)tupleCount, attributeCount - 1 - i); // Size of the subtree
+            task.run = [this, i](duckdb::Connection &, int, int) {
+                PartitionStack stack(attributeCount);
+                stack.owned[1] = columnPartition(relation->column(i), tupleCount, relation->cardinality(i), &stack.arenas[1]);
+                const StrippedPartition &single = stack.owned[1];
+                if (single.classCount() == 0) {
+                    setKey({i});
+                    return;
+                }
+                setEntropy({i}, getLogN() - (single.sumCLogC / tupleCount));
+                if (single.classCount() == 1 && single.rowCount() == (size_t)tupleCount) {
+                    addDependency({}, i); // A constant column
+                }
+                stack.path[1] = &single;
+                descend(stack, {i}, 1);
+            };
+            tasks.push_back(std::move(task));
+        }
+        scheduler.runLevel(tasks);
+        relation.reset();
+    }
+
+    void recurseAttSets(int limit, int start, AttributeSet currSet) {
+        LatticeScheduler scheduler(db, threadCount);
+
+        auto root = computeEntropy(conn, currSet);
+        if (!root.found) {
+            return;
+        }
+        double entropy = getLogN() - (root.sum.value() / tupleCount);
+        setEntropy(currSet, entropy);
+
+        submitChildren(scheduler, limit, start, {currSet, root.rows, root.classes, entropy});
+        scheduler.drain();
+    }
+
+public:
+    SchemaMinerSimple(const std::string& csvPath, int attributeCount) : Base(csvPath, attributeCount) {}
+
+    // Compute the lattice one level at a time (Apriori) instead of
+    // expanding each node as soon as it finishes; always on under a budget
+    void setLevelwise(bool enable) {
+        levelwise = enable;
+    }
+
+    // Walk the lattice depth-first over stripped partitions, refining the
+    // parent's partition by one column per child instead of querying the
+    // base table for every set. Only the partitions along each worker's
+    // current path are kept, so memory is bounded by the depth of the
+    // lattice rather than its width. Level-wise mining and budgets take
+    // precedence.
+    void setPartitionStack(bool enable) {
+        partitionStack = enable;
+    }
+
+    void computeEntropies() override {
+        startBudget();
+        if (partitionStack && !levelwise && !budgeted()) {
+            computeDepthFirst();
+            finishBudget(attributeCount);
+            return;
+        }
+        loadData();
+
+        if (levelwise || budgeted()) {
+            LatticeScheduler scheduler(db, threadCount);
+            watchBudget(scheduler);
+            auto root = computeEntropy(conn, {});
+            int completeLevel = attributeCount;
+            if (root.found) {
+                double entropy = getLogN() - (root.sum.value() / tupleCount);
+                setEntropy({}, entropy);
+                completeLevel = computeLevels(scheduler, {{}, root.rows, root.classes, entropy});
+            }
+            finishBudget(completeLevel);
+            return;
+        }
         recurseAttSets(attributeCount, 0, {});
+        finishBudget(attributeCount);
     }
 
 };
 
-int main() {
-    SchemaMinerSimple simple("datasets/restaurant.csv", 12);
+template <int Words>
+class SchemaMinerPartition : public SchemaMiner<Words> {
+private:
+    using Base = SchemaMiner<Words>;
+    using AttributeSet = typename Base::AttributeSet;
+    using Node = typename Base::Node;
+    using Base::db;
+    using Base::conn;
+    using Base::csvPath;
+    using Base::attributeCount;
+    using Base::tupleCount;
+    using Base::entropies;
+    using Base::threadCount;
+    using Base::getLogN;
+    using Base::setEntropy;
+    using Base::setKey;
+    using Base::coveredByKey;
+    using Base::budgeted;
+    using Base::budgetLevels;
+    using Base::startBudget;
+    using Base::watchBudget;
+    using Base::finishBudget;
+    using Base::addDependency;
+    using Base::isDetermined;
+    using Base::isKnown;
+    using Base::toPhysical;
+    using Base::toLogical;
+    using Base::fillCheckpoint;
+    using Base::restoreCheckpoint;
+
+    std::unique_ptr<EncodedRelation> relation;
+    bool replicateColumns = false;
+
+    // Partitions are bump-allocated from per-level, per-worker arenas
+    std::unique_ptr<LevelArenas> arenas;
+    bool hugePages = false;
+    bool compressPartitions = false;
+    bool levelwise = false;
+
+    // Multi-process mining: which slice of the lattice this process owns,
+    // and an already encoded relation to map instead of parsing the CSV
+    LatticeSharding sharding;
+    int shardIndex = -1;
+    std::string relationPath;
+
+    // Partitions computed by entropy(), kept as ancestors for later requests
+    // up to oracleBudget bytes; the least recently used go first
+    struct OraclePartition {
+        std::shared_ptr<StrippedPartition> partition;
+        uint64_t lastUse = 0;
+    };
+
+    std::unordered_map<AttributeSet, OraclePartition, AttributeMaskHash<Words>> oracleCache;
+    std::mutex oracleLock;
+    size_t oracleBytes = 0;
+    size_t oracleBudget = (size_t)256 << 20;
+    uint64_t oracleClock = 0;
+
+    // Level-wise runs save their state here after a level completes, at
+    // most once per checkpointInterval, and can resume from it
+    std::string checkpointPath;
+    std::chrono::seconds checkpointInterval{0};
+    bool resume = false;
+    uint64_t checkpointFingerprint = 0;
+    std::chrono::steady_clock::time_point lastCheckpoint;
+
+    bool ownsSingle(int a) {
+        return shardIndex < 0 || sharding.ownerOfSingle(a) == shardIndex;
+    }
+
+    bool ownsPrefix(int a, int b) {
+        return shardIndex < 0 || sharding.ownerOfPrefix(a, b) == shardIndex;
+    }
+
+    // One scan of the parent's classes plus the groups it can split into
+    template <typename Partition>
+    double estimateCost(const Partition &parent, int att) {
+        return parent.rowCount() + std::min<double>(parent.rowCount(), (double)parent.classCount() * relation->cardinality(att));
+    }
+
+    // A node's partition in whichever form was kept; both are empty for
+    // leaves, which nothing refines. `level` is the arena level holding it,
+    // which is below the node's own when it shares an ancestor's partition.
+    struct ChildPartition {
+        std::shared_ptr<StrippedPartition> plain;
+        std::shared_ptr<CompressedPartition> packed;
+        int level = 0;
+
+        bool empty() const {
+            return !plain && !packed;
+        }
+
+        size_t rowCount() const {
+            return packed ? packed->rowCount() : plain->rowCount();
+        }
+
+        size_t classCount() const {
+            return packed ? packed->classCount() : plain->classCount();
+        }
+
+        double sumCLogC() const {
+            return packed ? packed->sumCLogC : plain->sumCLogC;
+        }
+
+        int node() const {
+            return packed ? packed->node() : plain ? plain->node() : -1;
+        }
+    };
+
+    using Traversal = LevelTraversal<Words, ChildPartition>;
+
+    double estimateCost(const ChildPartition &parent, int att) {
+        return parent.packed ? estimateCost(*parent.packed, att) : estimateCost(*parent.plain, att);
+    }
+
+    // Refines parent, the partition of attSet, by attribute i into the
+    // arena one level below the parent's and passes the child's entropy and
+    // partition to emit, unless it has no common values. With compression
+    // on, the child is built in per-thread scratch memory and kept in
+    // whichever form is smaller.
+    //
+    // If attSet → i is implied by a known dependency, or the refinement
+    // splits nothing, the child shares the parent's partition and entropy.
+    template <typename Emit>
+    void refineChild(const AttributeSet &attSet, const ChildPartition &parent, int i, Emit emit) {
+        bool leaf = i + 1 == attributeCount;
+        double parentEntropy = getLogN() - (parent.sumCLogC() / tupleCount);
+        if (isDetermined(attSet, i)) {
+            emit(parentEntropy, leaf ? ChildPartition() : parent);
+            return;
+        }
+
+        Arena &arena = arenas->get(parent.level + 1, currentWorker() + 1);
+        static thread_local Arena scratch;
+        if (compressPartitions) {
+            scratch.reset();
+        }
+
+        Arena *target = compressPartitions ? &scratch : &arena;
+        StrippedPartition child = parent.packed ? refinePartition(*parent.packed, relation->column(i), relation->cardinality(i), target)
+                                                : refinePartition(*parent.plain, relation->column(i), relation->cardinality(i), target);
+        auto newAttSet = attSet;
+        newAttSet.insert(i);
+        if (child.classCount() == 0) {
+            setKey(newAttSet); // No common values, prune this branch
+            return;
+        }
+        if (child.rowCount() == parent.rowCount() && child.classCount() == parent.classCount()) {
+            // Refining only ever splits classes or drops rows, so nothing changed
+            addDependency(attSet, i);
+            if (!compressPartitions) {
+                arena.trim(child.rows.data(), 0);
+            }
+            emit(parentEntropy, leaf ? ChildPartition() : parent);
+            return;
+        }
+        double entropy = getLogN() - (child.sumCLogC / tupleCount);
+
+        ChildPartition kept;
+        kept.level = parent.level + 1;
+        if (leaf) {
+            // A leaf: nothing will read its partition
+        } else if (!compressPartitions) {
+            kept.plain = std::make_shared<StrippedPartition>(std::move(child));
+        } else if (compressedBytes(child) < child.bytes()) {
+            kept.packed = std::make_shared<CompressedPartition>(compressPartition(child, &arena));
+        } else {
+            kept.plain = std::make_shared<StrippedPartition>(clonePartition(child, &arena));
+        }
+        emit(entropy, std::move(kept));
+    }
+
+    // Children are refined from the parent partition, which stays alive until
+    // the last child task holding it has run. Tasks are counted against the
+    // arena level they allocate from, so the parent's level outlives them.
+    // Each child prefers the NUMA node its parent partition was allocated on.
+    void submitChildren(LatticeScheduler &scheduler, const AttributeSet &attSet, const ChildPartition &partition) {
+        int last = attSet.last();
+        for (int i = last + 1; i < attributeCount; i++) {
+            if (attSet.size() == 1 && !ownsPrefix(last, i)) {
+                continue; // Another shard mines this sub-lattice
+            }
+            auto newAttSet = attSet;
+            newAttSet.insert(i);
+            if (coveredByKey(newAttSet)) {
+                continue; // Contains a key: its entropy is implied
+            }
+            int level = partition.level + 1;
+            LatticeTask task;
+            task.cost = estimateCost(partition, i);
+            task.node = partition.node();
+            task.run = [this, &scheduler, attSet, newAttSet, partition, i](duckdb::Connection &, int, int) {
+                refineChild(attSet, partition, i, [&](double entropy, ChildPartition child) {
+                    scheduler.fold([this, newAttSet, entropy] {
+                        setEntropy(newAttSet, entropy);
+                    });
+                    if (!child.empty()) {
+                        submitChildren(scheduler, newAttSet, child);
+                    }
+                });
+            };
+            task.finish = [this, level](duckdb::Connection &) {
+                arenas->taskFinished(level);
+            };
+            arenas->taskSubmitted(level);
+            scheduler.submit(std::move(task));
+        }
+    }
+
+    // One runLevel() batch per lattice level, up to the budget's level
+    // limit; returns the last level completed. Once the next level has been
+    // refined, every arena level below the lowest one it still uses is
+    // released.
+    int computeLevels(LatticeScheduler &scheduler, std::vector<typename Traversal::Entry> first) {
+        int liveFloor = 0;
+        int releasedBelow = 0;
+        auto expand = [this, &scheduler, &liveFloor](const std::vector<typename Traversal::Entry> &level,
+                                                     const std::vector<typename Traversal::Candidate> &candidates,
+                                                     std::vector<std::optional<ChildPartition>> &results) {
+            std::vector<LatticeTask> tasks;
+            for (size_t c = 0; c < candidates.size(); c++) {
+                const typename Traversal::Entry &parent = level[candidates[c].parent];
+                LatticeTask task;
+                task.cost = estimateCost(parent.state, candidates[c].attribute);
+                task.node = parent.state.node();
+                task.run = [this, &candidates, &results, &parent, c](duckdb::Connection &, int, int) {
+                    refineChild(parent.attSet, parent.state, candidates[c].attribute, [&](double entropy, ChildPartition child) {
+                        setEntropy(candidates[c].attSet, entropy);
+                        results[c] = std::move(child);
+                    });
+                };
+                tasks.push_back(std::move(task));
+            }
+            bool complete = scheduler.runLevel(tasks);
+
+            liveFloor = attributeCount + 1;
+            for (const auto &result : results) {
+                if (result && !result->empty()) {
+                    liveFloor = std::min(liveFloor, result->level);
+                }
+            }
+            if (complete && !checkpointPath.empty() && std::chrono::steady_clock::now() - lastCheckpoint >= checkpointInterval) {
+                std::vector<AttributeSet> frontier;
+                for (size_t c = 0; c < candidates.size(); c++) {
+                    if (results[c]) {
+                        frontier.push_back(candidates[c].attSet);
+                    }
+                }
+                writeCheckpoint(frontier);
+            }
+            return complete;
+        };
+        auto released = [this, &liveFloor, &releasedBelow](int level) {
+            for (; releasedBelow < std::min(liveFloor, level + 2); releasedBelow++) {
+                arenas->release(releasedBelow);
+            }
+        };
+        int completeLevel = Traversal::run(attributeCount, std::move(first), expand, released, budgetLevels());
+        if (completeLevel == attributeCount && !checkpointPath.empty()) {
+            writeCheckpoint({});
+        }
+        return completeLevel;
+    }
+
+    // frontier is the last completed level, in traversal order
+    void writeCheckpoint(const std::vector<AttributeSet> &frontier) {
+        Checkpoint<AttributeSet> checkpoint;
+        checkpoint.fingerprint = checkpointFingerprint;
+        fillCheckpoint(checkpoint);
+        for (const auto &attSet : frontier) {
+            checkpoint.frontier.push_back(toPhysical.apply(attSet));
+        }
+        writeCheckpointFile(checkpointPath, checkpoint);
+        lastCheckpoint = std::chrono::steady_clock::now();
+    }
+
+    // Restores a checkpoint and rebuilds the partitions of its frontier from
+    // the columns, as the level the traversal continues from. Returns false
+    // if the budget ran out first.
+    bool resumeFrom(LatticeScheduler &scheduler, const Checkpoint<AttributeSet> &checkpoint, std::vector<typename Traversal::Entry> &frontier) {
+        restoreCheckpoint(checkpoint, checkpointFingerprint);
+        frontier.resize(checkpoint.frontier.size());
+        std::vector<LatticeTask> tasks;
+        for (size_t f = 0; f < frontier.size(); f++) {
+            frontier[f].attSet = toLogical.apply(checkpoint.frontier[f]);
+            if (frontier[f].attSet.last() + 1 == attributeCount) {
+                continue; // A leaf keeps no partition
+            }
+            LatticeTask task;
+            task.cost = (double)tupleCount * frontier[f].attSet.size();
+            task.run = [this, &frontier, f](duckdb::Connection &, int, int) {
+                AttributeSet current;
+                std::shared_ptr<StrippedPartition> partition;
+                for (int a : frontier[f].attSet) {
+                    partition = extendPartition(current, partition, a);
+                }
+                frontier[f].state = ChildPartition{partition, nullptr, (int)current.size()};
+            };
+            tasks.push_back(std::move(task));
+        }
+        return scheduler.runLevel(tasks);
+    }
+
+    void loadRelation() {
+        if (relationPath.empty()) {
+            relation.reset(new EncodedRelation(EncodedRelation::fromCsv(csvPath, attributeCount, replicateColumns)));
+        } else {
+            relation.reset(new EncodedRelation(EncodedRelation::open(relationPath)));
+        }
+        tupleCount = relation->tuples();
+        std::lock_guard<std::mutex> guard(oracleLock);
+        oracleCache.clear();
+        oracleBytes = 0;
+    }
+
+    void cacheOraclePartition(const AttributeSet &attSet, const std::shared_ptr<StrippedPartition> &partition) {
+        std::lock_guard<std::mutex> guard(oracleLock);
+        OraclePartition &entry = oracleCache[attSet];
+        entry.lastUse = ++oracleClock;
+        if (entry.partition) {
+            return;
+        }
+        entry.partition = partition;
+        oracleBytes += partition->bytes();
+        while (oracleBytes > oracleBudget && oracleCache.size() > 1) {
+            auto victim = oracleCache.end();
+            for (auto it = oracleCache.begin(); it != oracleCache.end(); ++it) {
+                if (it->first != attSet && (victim == oracleCache.end() || it->second.lastUse < victim->second.lastUse)) {
+                    victim = it;
+                }
+            }
+            oracleBytes -= victim->second.partition->bytes();
+            oracleCache.erase(victim);
+        }
+    }
+
+    // Adds attribute a to current, whose partition is given (null for the
+    // empty set), and stores the entropy of the result. Returns its
+    // partition, or null if it is a key.
+    std::shared_ptr<StrippedPartition> extendPartition(AttributeSet &current, std::shared_ptr<StrippedPartition> partition, int a) {
+        if (!partition) {
+            partition = std::make_shared<StrippedPartition>(columnPartition(relation->column(a), tupleCount, relation->cardinality(a)));
+        } else if (!isDetermined(current, a)) {
+            StrippedPartition child = refinePartition(*partition, relation->column(a), relation->cardinality(a));
+            if (child.rowCount() == partition->rowCount() && child.classCount() == partition->classCount()) {
+                addDependency(current, a);
+            } else {
+                partition = std::make_shared<StrippedPartition>(std::move(child));
+            }
+        }
+        current.insert(a);
+        if (partition->classCount() == 0) {
+            setKey(current);
+            return nullptr;
+        }
+        setEntropy(current, getLogN() - (partition->sumCLogC / tupleCount));
+        return partition;
+    }
+
+    // The cached subset of attSet with the fewest rows left to refine or,
+    // failing that, the partition of its most selective column. Null if
+    // that column has no common values, which makes it a key.
+    std::pair<AttributeSet, std::shared_ptr<StrippedPartition>> oracleAncestor(const AttributeSet &attSet) {
+        {
+            std::lock_guard<std::mutex> guard(oracleLock);
+            auto best = oracleCache.end();
+            for (auto it = oracleCache.begin(); it != oracleCache.end(); ++it) {
+                if (it->first.isSubsetOf(attSet) && (best == oracleCache.end() || it->second.partition->rowCount() < best->second.partition->rowCount())) {
+                    best = it;
+                }
+            }
+            if (best != oracleCache.end()) {
+                best->second.lastUse = ++oracleClock;
+                return {best->first, best->second.partition};
+            }
+        }
+        int att = attSet.first();
+        for (int a : attSet) {
+            if (relation->cardinality(a) > relation->cardinality(att)) {
+                att = a;
+            }
+        }
+        AttributeSet single;
+        auto partition = extendPartition(single, nullptr, att);
+        if (partition) {
+            cacheOraclePartition(single, partition);
+        }
+        return {single, partition};
+    }
+
+    // Refines the cheapest cached ancestor of attSet up to it, most selective
+    // attributes first, storing and caching every set on the way
+    void computeOracleEntry(const AttributeSet &attSet) {
+        if (isKnown(attSet)) {
+            return;
+        }
+        if (attSet.empty()) {
+            setEntropy(attSet, 0);
+            return;
+        }
+        auto [current, partition] = oracleAncestor(attSet);
+        if (!partition) {
+            return;
+        }
+        std::vector<int> remaining;
+        for (int a : attSet) {
+            if (!current.contains(a)) {
+                remaining.push_back(a);
+            }
+        }
+        std::stable_sort(remaining.begin(), remaining.end(), [this](int a, int b) {
+            return relation->cardinality(a) > relation->cardinality(b);
+        });
+
+        for (int a : remaining) {
+            partition = extendPartition(current, partition, a);
+            if (!partition) {
+                return; // A key inside attSet answers it too
+            }
+            cacheOraclePartition(current, partition);
+        }
+        if (remaining.empty()) {
+            setEntropy(current, getLogN() - (partition->sumCLogC / tupleCount));
+        }
+    }
+
+    // Sets of one size are refined concurrently, one size after another
+    void computeOnDemand(const std::vector<AttributeSet> &attSets) override {
+        if (!relation) {
+            loadRelation();
+        }
+        LatticeScheduler scheduler(db, threadCount);
+        size_t start = 0;
+        while (start < attSets.size()) {
+            size_t end = start;
+            std::vector<LatticeTask> tasks;
+            for (; end < attSets.size() && attSets[end].size() == attSets[start].size(); end++) {
+                LatticeTask task;
+                task.cost = attSets[end].size();
+                task.run = [this, &attSets, end](duckdb::Connection &, int, int) {
+                    computeOracleEntry(attSets[end]);
+                };
+                tasks.push_back(std::move(task));
+            }
+            scheduler.runLevel(tasks);
+            start = end;
+        }
+    }
+
+    using Plan = TargetPlan<Words>;
+
+    // Runs step s of the plan from its parent step's partition (null at the
+    // root) and queues the steps refined from it, which share its partition
+    void submitTargetStep(LatticeScheduler &scheduler, const Plan &plan, const std::vector<std::vector<int>> &children, int s,
+                          std::shared_ptr<StrippedPartition> parent) {
+        const auto &step = plan.steps[s];
+        LatticeTask task;
+        task.cost = (double)(parent ? parent->rowCount() : tupleCount) * step.attributes.size();
+        task.node = parent ? parent->node() : -1;
+        task.run = [this, &scheduler, &plan, &children, s, parent](duckdb::Connection &, int, int) {
+            const auto &step = plan.steps[s];
+            if (step.attSet.empty()) {
+                setEntropy(step.attSet, 0);
+                return;
+            }
+            AttributeSet current = step.attSet;
+            for (int a : step.attributes) {
+                current.erase(a);
+            }
+            std::shared_ptr<StrippedPartition> partition = parent;
+            for (int a : step.attributes) {
+                partition = extendPartition(current, partition, a);
+                if (!partition) {
+                    return; // A key: every later set on this path contains it
+                }
+            }
+            for (int child : children[s]) {
+                submitTargetStep(scheduler, plan, children, child, partition);
+            }
+        };
+        scheduler.submit(std::move(task));
+    }
+
+    // The plan's steps are pipelined; a step's partition is freed once the
+    // last step refined from it has run
+    void computeTargetSets(const std::vector<AttributeSet> &targets) override {
+        if (!relation) {
+            loadRelation();
+        }
+        std::vector<double> cardinality;
+        for (int a = 0; a < attributeCount; a++) {
+            cardinality.push_back(relation->cardinality(a));
+        }
+        Plan plan = Plan::build(targets, Plan::rankByUse(targets, cardinality));
+        std::vector<std::vector<int>> children(plan.steps.size());
+        for (size_t s = 0; s < plan.steps.size(); s++) {
+            if (plan.steps[s].parent >= 0) {
+                children[plan.steps[s].parent].push_back((int)s);
+            }
+        }
+
+        LatticeScheduler scheduler(db, threadCount);
+        for (size_t s = 0; s < plan.steps.size(); s++) {
+            if (plan.steps[s].parent < 0) {
+                submitTargetStep(scheduler, plan, children, (int)s, nullptr);
+            }
+        }
+        scheduler.drain();
+    }
+
+public:
+    SchemaMinerPartition(const std::string& csvPath, int attributeCount) : Base(csvPath, attributeCount) {}
+
+    // Bytes of partitions entropy() keeps to refine later requests from
+    void setOracleCacheBudget(size_t bytes) {
+        oracleBudget = bytes;
+    }
+
+    // Keep a copy of the encoded columns on every NUMA node instead of
+    // interleaving a single copy across them
+    void setReplicateColumns(bool replicate) {
+        replicateColumns = replicate;
+    }
+
+    // Back partition arenas with 2 MB huge pages: explicit ones if reserved,
+    // transparent ones otherwise
+    void setHugePages(bool enable) {
+        hugePages = enable;
+    }
+
+    // Keep partitions as delta-encoded, bit-packed blocks where that is
+    // smaller, so more of the lattice frontier fits in memory
+    void setCompressPartitions(bool compress) {
+        compressPartitions = compress;
+    }
+
+    // Refine one lattice level at a time (Apriori) instead of pipelining
+    // nodes as they finish; candidates whose subsets were pruned are skipped.
+    // Always on under a budget.
+    void setLevelwise(bool enable) {
+        levelwise = enable;
+    }
+
+    // Mine only the slice of the lattice owned by shard `index` of `count`
+    void setShard(int index, int count) {
+        sharding = LatticeSharding(attributeCount, count);
+        shardIndex = index;
+    }
+
+    // Map a relation written by EncodedRelation::writeTo instead of the CSV
+    void setRelationFile(const std::string &path) {
+        relationPath = path;
+    }
+
+    // Save the run's state to `path` (atomically replaced) whenever a level
+    // completes and `interval` has passed since the last save, and when the
+    // run finishes. Implies the level-wise traversal.
+    void setCheckpoint(const std::string &path, std::chrono::seconds interval = std::chrono::seconds(0)) {
+        checkpointPath = path;
+        checkpointInterval = interval;
+    }
+
+    // Continue from the checkpoint file, if it exists, instead of starting
+    // over; the checkpoint must have been taken of the same data
+    void setResume(bool enable) {
+        resume = enable;
+    }
+
+    void computeEntropies() override {
+        bool byLevel = levelwise || budgeted() || !checkpointPath.empty();
+        if (byLevel && shardIndex >= 0) {
+            throw std::runtime_error("Level-wise traversal, which a budget or checkpoints imply, needs every subset of a candidate, so it cannot run sharded");
+        }
+        startBudget();
+        loadRelation();
+        setEntropy({}, 0); // A single class of every row
+
+        LatticeScheduler scheduler(db, threadCount, 1 << 16, &NumaTopology::get());
+        watchBudget(scheduler);
+        arenas.reset(new LevelArenas(attributeCount + 1, scheduler.getThreadCount() + 1, hugePages));
+        std::vector<typename Traversal::Entry> first;
+        bool resuming = false;
+        if (!checkpointPath.empty()) {
+            checkpointFingerprint = datasetFingerprint(csvPath);
+            lastCheckpoint = std::chrono::steady_clock::now();
+            struct stat info;
+            resuming = resume && stat(checkpointPath.c_str(), &info) == 0;
+        }
+        if (resuming && !resumeFrom(scheduler, readCheckpointFile<AttributeSet>(checkpointPath), first)) {
+            finishBudget(first.front().attSet.size()); // Only what the checkpoint held
+            arenas.reset();
+            return;
+        }
+        for (int i = 0; i < attributeCount && !resuming; i++) {
+            auto partition = std::make_shared<StrippedPartition>(columnPartition(relation->column(i), tupleCount, relation->cardinality(i), &arenas->get(1, 0)));
+            if (partition->classCount() == 0) {
+                if (ownsSingle(i)) {
+                    setKey({i});
+                }
+                continue;
+            }
+            if (ownsSingle(i)) {
+                setEntropy({i}, getLogN() - (partition->sumCLogC / tupleCount));
+            }
+            if (partition->classCount() == 1 && partition->rowCount() == (size_t)tupleCount) {
+                addDependency({}, i); // A constant column
+            }
+            ChildPartition single{partition, nullptr, 1};
+            if (byLevel) {
+                first.push_back({{i}, single});
+            } else {
+                submitChildren(scheduler, {i}, single);
+            }
+        }
+        if (byLevel) {
+            finishBudget(computeLevels(scheduler, std::move(first)));
+        } else {
+            scheduler.drain();
+            finishBudget(attributeCount);
+        }
+        arenas.reset();
+        ArenaChunkPool::get().clear();
+    }
+
+    void writeShard(const std::string &path) {
+        std::vector<std::pair<AttributeSet, double>> shard;
+        entropies.forEach([&](const AttributeSet &attSet, double entropy) {
+            shard.push_back({attSet, entropy});
+        });
+        std::vector<AttributeSet> keys;
+        entropies.forEachKey([&](const AttributeSet &key) {
+            keys.push_back(key);
+        });
+        writeShardFile(path, shard, keys, getLogN());
+    }
+
+    // Adds a shard's entropies, and its minimal keys as keys
+    void mergeShard(const std::string &path) {
+        readShardFile<AttributeSet>(path, [this](const AttributeSet &attSet, double entropy) {
+            entropies.insert(attSet, entropy);
+        }, [this](const AttributeSet &key, double entropy) {
+            entropies.addKey(key, entropy);
+        });
+    }
+
+    // Coordinator: encodes the relation once, mines it with `workers` local
+    // worker processes that map the encoded file, and merges their shards
+    void computeEntropiesSharded(int workers, const std::string &workDir = "/tmp") {
+        std::string prefix = workDir + "/schema_miner_" + std::to_string(getpid());
+        std::string relationFile = prefix + ".rel";
+        EncodedRelation encoded = EncodedRelation::fromCsv(csvPath, attributeCount, false);
+        encoded.writeTo(relationFile);
+        tupleCount = encoded.tuples();
+        setEntropy({}, 0);
+
+        std::vector<pid_t> pids;
+        for (int i = 0; i < workers; i++) {
+            pids.push_back(spawnWorker({"run_program", "--worker", csvPath, std::to_string(attributeCount), relationFile,
+                                        std::to_string(i), std::to_string(workers), prefix + "_" + std::to_string(i) + ".shard"}));
+        }
+
+        bool failed = false;
+        for (int i = 0; i < workers; i++) {
+            std::string shardFile = prefix + "_" + std::to_string(i) + ".shard";
+            if (waitWorker(pids[i])) {
+                mergeShard(shardFile);
+            } else {
+                std::cerr << "Worker " << i << " failed\n";
+                failed = true;
+            }
+            std::remove(shardFile.c_str());
+        }
+        std::remove(relationFile.c_str());
+        if (failed) {
+            throw std::runtime_error("Sharded mining did not complete");
+        }
+    }
+};
+
+// Usage:
+//   run_program --coordinator <csv> <attributes> <workers>
+//   run_program --worker <csv> <attributes> <relation file> <shard> <shards> <shard file>
+//   run_program --resume <csv> <attributes> <checkpoint file>
+// --resume continues from the checkpoint file if it exists and checkpoints
+// to it every minute, so a killed run can be restarted with the same command.
+// Workers can also be started by hand on other hosts that share the
+// relation file; the coordinator merges shard files with mergeShard().
+int main(int argc, char **argv) {
+    if (argc == 8 && std::string(argv[1]) == "--worker") {
+        withLatticeWidth<SchemaMinerPartition>(argv[2], std::stoi(argv[3]), [&](auto &worker) {
+            worker.setRelationFile(argv[4]);
+            worker.setShard(std::stoi(argv[5]), std::stoi(argv[6]));
+            worker.computeEntropies();
+            worker.writeShard(argv[7]);
+        });
+        return 0;
+    }
+    if (argc == 5 && std::string(argv[1]) == "--coordinator") {
+        withLatticeWidth<SchemaMinerPartition>(argv[2], std::stoi(argv[3]), [&](auto &coordinator) {
+            auto start = std::chrono::high_resolution_clock::now();
+            coordinator.computeEntropiesSharded(std::stoi(argv[4]));
+            auto end = std::chrono::high_resolution_clock::now();
+            coordinator.printEntropies();
+            std::cout << "Time taken (Sharded): " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms\n";
+        });
+        return 0;
+    }
+
+    if (argc == 5 && std::string(argv[1]) == "--resume") {
+        withLatticeWidth<SchemaMinerPartition>(argv[2], std::stoi(argv[3]), [&](auto &miner) {
+            miner.setCheckpoint(argv[4], std::chrono::seconds(60));
+            miner.setResume(true);
+            auto start = std::chrono::high_resolution_clock::now();
+            miner.computeEntropies();
+            auto end = std::chrono::high_resolution_clock::now();
+            miner.printEntropies();
+            std::cout << "Time taken (Partition, resumable): " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms\n";
+        });
+        return 0;
+    }
+
+    SchemaMinerSimple<1> simple("datasets/restaurant.csv", 12);
     auto start = std::chrono::high_resolution_clock::now();
     simple.computeEntropies();
     auto end = std::chrono::high_resolution_clock::now();
     simple.printEntropies();
     std::cout << "Time taken (Simple): " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms\n";
 
-    SchemaMinerTIDCNT tid("datasets/restaurant.csv", 12);
+    SchemaMinerTIDCNT<1> tid("datasets/restaurant.csv", 12);
     start = std::chrono::high_resolution_clock::now();
     tid.computeEntropies();
     end = std::chrono::high_resolution_clock::now();
     tid.printEntropies();
     std::cout << "Time taken (TID/CNT): " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms\n";
 
-    // SchemaMinerBUC buc("datasets/small.csv", 4);
+    SchemaMinerPartition<1> partition("datasets/restaurant.csv", 12);
+    start = std::chrono::high_resolution_clock::now();
+    partition.computeEntropies();
+    end = std::chrono::high_resolution_clock::now();
+    partition.printEntropies();
+    std::cout << "Time taken (Partition): " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms\n";
+
+    // SchemaMinerBUC<1> buc("datasets/small.csv", 4);
     // start = std::chrono::high_resolution_clock::now();
     // buc.computeEntropies();
     // end = std::chrono::high_resolution_clock::now();